@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lexer/lexer.h"
+
+// Lexing throughput benchmark, only built with -DVELVET_BUILD_BENCHMARKS=ON
+//  - the input files (every sample by default) are concatenated and repeated up to the target size, then lexed
+//    to the end a few times, the best run is reported
+//  - the lexer's interface hasn't changed since it started lexing on demand, so older lexer.cpp versions can be
+//    dropped in and measured with the same benchmark
+//
+// usage: VelvetLexerBenchmark [--size=MB] [--runs=N] [file.vv...]
+
+namespace {
+    bool _parseCount(std::string_view count, unsigned int& result) {
+        const char* countEnd = count.data() + count.size();
+        unsigned int value = 0;
+        const std::from_chars_result parsed = std::from_chars(count.data(), countEnd, value);
+        if (parsed.ec != std::errc() || parsed.ptr != countEnd || value == 0) {
+            return false;
+        }
+        result = value;
+        return true;
+    }
+
+    bool _readFile(const std::string& fileName, std::string& contents) {
+        std::ifstream file(fileName, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        contents.append(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        contents += '\n';
+        return true;
+    }
+
+    size_t _lexAll(std::string_view source) {
+        Lexer lexer(source);
+        size_t tokenCount = 0;
+        while (lexer.getCurrToken() != Token::TOK_EOF) {
+            lexer.consumeToken();
+            ++tokenCount;
+        }
+        return tokenCount;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    unsigned int sizeMB = 64;
+    unsigned int runs = 5;
+    std::vector<std::string> inputFiles;
+    for (int index = 1; index < argc; ++index) {
+        const std::string_view argument = argv[index];
+        if (argument.rfind("--size=", 0) == 0) {
+            // token offsets are 32 bit, so the input has to stay under 4 GB
+            if (!_parseCount(argument.substr(7), sizeMB) || sizeMB > 4000) {
+                std::fprintf(stderr, "Invalid size %s\n", argv[index]);
+                return 1;
+            }
+        }
+        else if (argument.rfind("--runs=", 0) == 0) {
+            if (!_parseCount(argument.substr(7), runs)) {
+                std::fprintf(stderr, "Invalid run count %s\n", argv[index]);
+                return 1;
+            }
+        }
+        else {
+            inputFiles.emplace_back(argument);
+        }
+    }
+    if (inputFiles.empty()) {
+        for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(VELVET_SAMPLES_DIR)) {
+            if (entry.path().extension() == ".vv") {
+                inputFiles.push_back(entry.path().string());
+            }
+        }
+        // directory order isn't stable, the input should be the same on every run
+        std::sort(inputFiles.begin(), inputFiles.end());
+    }
+
+    std::string sources;
+    for (const std::string& inputFile : inputFiles) {
+        if (!_readFile(inputFile, sources)) {
+            std::fprintf(stderr, "Could not read %s\n", inputFile.c_str());
+            return 1;
+        }
+    }
+    if (sources.empty()) {
+        std::fprintf(stderr, "No input to lex\n");
+        return 1;
+    }
+    const size_t targetSize = static_cast<size_t>(sizeMB) * 1024 * 1024;
+    std::string input;
+    input.reserve(targetSize + sources.size());
+    while (input.size() < targetSize) {
+        input += sources;
+    }
+
+    size_t tokenCount = 0;
+    double bestSeconds = 0.0;
+    for (unsigned int run = 0; run < runs; ++run) {
+        const auto start = std::chrono::steady_clock::now();
+        tokenCount = _lexAll(input);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (run == 0 || elapsed.count() < bestSeconds) {
+            bestSeconds = elapsed.count();
+        }
+    }
+    const double inputMB = static_cast<double>(input.size()) / (1024.0 * 1024.0);
+    std::printf("lexed %.1f MB (%zu tokens) from %zu files\n", inputMB, tokenCount, inputFiles.size());
+    std::printf("best of %u: %.3f s, %.1f MB/s\n", runs, bestSeconds, inputMB / bestSeconds);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+#include "session.h"
+
+#include <algorithm>
+
+#include "builder/builder.h"
+#include "cache/buildCache.h"
+#include "composer/composer.h"
+#include "jit/jit.h"
+
+VelvetSession::VelvetSession(const BuildOptions& options)
+    : mOptions(options)
+    , mErrorHandler(true)
+{
+    // everything a session compiles goes through the JIT, which matters for the cache keys
+    mOptions.mRunJIT = true;
+    // sources are added one at a time, there is never a point where the whole program could be linked
+    mOptions.mLinkTimeOptimization = false;
+    TargetBuilder::resolveNativeTarget(mOptions);
+    if (!mOptions.mCacheDirectory.empty()) {
+        mCache = std::make_unique<BuildCache>(mOptions.mCacheDirectory);
+    }
+    mTargets = std::make_unique<PartitionTargets>(mOptions, mErrorHandler);
+    mJIT = std::make_unique<JITRunner>(mOptions, mErrorHandler, mCache.get());
+}
+
+VelvetSession::~VelvetSession() = default;
+
+bool VelvetSession::addSource(const std::string& source) {
+    if (!mTargets->getBuilder(0).getTargetMachine()) {
+        return false;
+    }
+    // the frontend stops at the first sign of an earlier error, so every compile needs a clean handler
+    ErrorHandler compileErrors(true);
+    const std::string name = "source" + std::to_string(mModuleCount++);
+    const unsigned int numPartitions = std::max(1u, mOptions.mCodegenPartitions);
+    std::string cacheKey = "";
+    if (mCache) {
+        cacheKey = BuildCache::computeKey(source, mOptions);
+        std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects;
+        for (unsigned int partition = 0; partition < numPartitions; ++partition) {
+            std::unique_ptr<llvm::MemoryBuffer> object = mCache->lookup(BuildCache::getPartitionKey(cacheKey, partition));
+            if (!object) {
+                break;
+            }
+            objects.push_back(std::move(object));
+        }
+        if (objects.size() == numPartitions) {
+            for (std::unique_ptr<llvm::MemoryBuffer>& object : objects) {
+                if (!mJIT->addObject(std::move(object))) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+    std::optional<std::vector<llvm::orc::ThreadSafeModule>> modules = Composer::compileModules(source, name, mOptions, *mTargets, compileErrors, nullptr);
+    mErrorHandler.logErrors(compileErrors);
+    if (!modules.has_value()) {
+        return false;
+    }
+    for (unsigned int partition = 0; partition < numPartitions; ++partition) {
+        llvm::orc::ThreadSafeModule& module = modules.value()[partition];
+        if (mCache) {
+            module.getModuleUnlocked()->setModuleIdentifier(BuildCache::getPartitionKey(cacheKey, partition));
+        }
+        if (!mJIT->addModule(std::move(module))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void* VelvetSession::getFunctionAddress(const std::string& name) {
+    return mJIT->getFunctionAddress(name);
+}
+
+const std::vector<std::string>& VelvetSession::getErrors() const {
+    return mErrorHandler.getErrors();
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "error/errorHandler.h"
+#include "options/options.h"
+
+class BuildCache;
+class PartitionTargets;
+class JITRunner;
+
+// Embeddable entry point, compiles velvet source strings straight into callable native functions
+//  - the JIT session is created once and reused by every compile, so only the new source is ever compiled
+//  - function pointers stay valid for as long as the session is alive
+//  - a session is not thread safe, use one per thread if compiling from multiple threads
+class VelvetSession {
+    BuildOptions mOptions;
+    ErrorHandler mErrorHandler;
+    std::unique_ptr<BuildCache> mCache;
+    std::unique_ptr<PartitionTargets> mTargets;
+    std::unique_ptr<JITRunner> mJIT;
+    size_t mModuleCount = 0;
+public:
+    VelvetSession(const BuildOptions& options = BuildOptions());
+    ~VelvetSession();
+
+    // adds every function in the source to the session, returns false if it failed to compile
+    bool addSource(const std::string& source);
+    // returns nullptr if no function with the name has been added
+    void* getFunctionAddress(const std::string& name);
+
+    // e.g. compileFunction<float(float, float)>("def func(a : f32, b : f32) @ f32 { a * b }", "func")
+    //  - the signature isn't checked against the velvet definition, it's up to the caller to match them
+    template<typename Signature>
+    Signature* compileFunction(const std::string& source, const std::string& name) {
+        if (!addSource(source)) {
+            return nullptr;
+        }
+        return reinterpret_cast<Signature*>(getFunctionAddress(name));
+    }
+
+    template<typename Signature>
+    Signature* getFunction(const std::string& name) {
+        return reinterpret_cast<Signature*>(getFunctionAddress(name));
+    }
+
+    // every error logged by the session so far, in order
+    const std::vector<std::string>& getErrors() const;
+};
\ No newline at end of file
@@ -1,62 +1,119 @@
 #include "builder.h"
 
+#include <mutex>
 #include <string>
-#include <iostream>
 #include <optional>
 
+#include "llvm/ADT/StringMap.h"
 #include "llvm/MC/TargetRegistry.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Host.h"
 #include "llvm/Support/TargetSelect.h"
 
-TargetBuilder::TargetBuilder() {
-    llvm::InitializeAllTargets();
-    llvm::InitializeAllTargetInfos();
-    llvm::InitializeAllTargetMCs();
-    llvm::InitializeAllAsmParsers();
-    llvm::InitializeAllAsmPrinters();
+TargetBuilder::TargetBuilder(const BuildOptions& options, ErrorHandler& errorHandler) {
+    initializeTargets();
 
     mTargetTriple = llvm::sys::getDefaultTargetTriple();
-    std::cout << mTargetTriple << '\n';
 
     std::string error;
     const llvm::Target* target = llvm::TargetRegistry::lookupTarget(mTargetTriple, error);
     if (!target) {
-        // TODO: Error
-        llvm::errs() << error;
+        errorHandler.logError("Could not find target " + mTargetTriple + ": " + error);
         return;
     }
 
-    const std::string cpu = "generic";
-    const std::string features = "";
-    llvm::TargetOptions options;
-    llvm::Optional<llvm::Reloc::Model> RM = llvm::Optional<llvm::Reloc::Model>();
-    mTargetMachine = target->createTargetMachine(mTargetTriple, cpu, features, options, RM);
+    const std::string& cpu = options.mTargetCPU;
+    const std::string& features = options.mTargetFeatures;
+    llvm::TargetOptions targetOptions = getTargetOptions(options);
+    // position independent so the objects can go into PIE executables, which Linux toolchains produce by default
+    llvm::Optional<llvm::Reloc::Model> RM = llvm::Reloc::PIC_;
+    const llvm::CodeGenOpt::Level optLevel = getCodeGenOptLevel(options.mOptimizationLevel);
+    mTargetMachine.reset(target->createTargetMachine(mTargetTriple, cpu, features, targetOptions, RM, llvm::None, optLevel));
+    if (!mTargetMachine) {
+        errorHandler.logError("Could not create target machine for " + mTargetTriple);
+    }
+}
 
+void TargetBuilder::initializeTargets() {
+    static std::once_flag initializeFlag;
+    std::call_once(initializeFlag, []() {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        llvm::InitializeNativeTargetAsmParser();
+    });
+}
 
+llvm::TargetOptions TargetBuilder::getTargetOptions(const BuildOptions& options) {
+    llvm::TargetOptions targetOptions;
+    // the per function fast math settings are function attributes and instruction flags, which the backend reads
+    //  on its own, only build wide contraction has no per function equivalent
+    if (options.mFastMath || options.mContractFloatOps) {
+        targetOptions.AllowFPOpFusion = llvm::FPOpFusion::Fast;
+    }
+    return targetOptions;
 }
 
-bool TargetBuilder::buildModule(std::unique_ptr<llvm::Module>& module, const std::string& fileName) {
-    module->setDataLayout(mTargetMachine->createDataLayout());
-    module->setTargetTriple(mTargetTriple);
+llvm::CodeGenOpt::Level TargetBuilder::getCodeGenOptLevel(OptimizationLevel level) {
+    switch (level) {
+        case OptimizationLevel::O1: return llvm::CodeGenOpt::Less;
+        case OptimizationLevel::O2: return llvm::CodeGenOpt::Default;
+        case OptimizationLevel::O3: return llvm::CodeGenOpt::Aggressive;
+        default: return llvm::CodeGenOpt::None;
+    }
+}
+
+void TargetBuilder::resolveNativeTarget(BuildOptions& options) {
+    if (options.mTargetCPU != "native") {
+        return;
+    }
+    options.mTargetCPU = llvm::sys::getHostCPUName().str();
+    llvm::StringMap<bool> hostFeatures;
+    std::string features = "";
+    if (llvm::sys::getHostCPUFeatures(hostFeatures)) {
+        for (const auto& feature : hostFeatures) {
+            features += (features.empty() ? "" : ",") + std::string(feature.getValue() ? "+" : "-") + feature.getKey().str();
+        }
+    }
+    // explicitly requested features come last so they override what was detected
+    if (!options.mTargetFeatures.empty()) {
+        features += (features.empty() ? "" : ",") + options.mTargetFeatures;
+    }
+    options.mTargetFeatures = features;
+}
+
+llvm::TargetMachine* TargetBuilder::getTargetMachine() const {
+    return mTargetMachine.get();
+}
+
+void TargetBuilder::prepareModule(llvm::Module& module) const {
+    module.setDataLayout(mTargetMachine->createDataLayout());
+    module.setTargetTriple(mTargetTriple);
+}
+
+bool TargetBuilder::buildModule(llvm::Module& module, const std::string& fileName, ErrorHandler& errorHandler) {
+    prepareModule(module);
 
     std::error_code errorCode;
     llvm::raw_fd_ostream destination(fileName, errorCode, llvm::sys::fs::OF_None);
     if (errorCode) {
-        // TODO: Error
-        llvm::errs() << "Could not open file: " << errorCode.message();
+        errorHandler.logError("Could not open object file " + fileName + ": " + errorCode.message());
         return false;
     }
 
     llvm::legacy::PassManager passManager;
     llvm::CodeGenFileType fileType = llvm::CGFT_ObjectFile;
     if (mTargetMachine->addPassesToEmitFile(passManager, destination, nullptr, fileType)) {
-        // TODO: Error
-        llvm::errs() << "Target machine can't emit file of this type\n";
+        errorHandler.logError("Target machine can't emit an object file for " + fileName);
         return false;
     }
 
-    passManager.run(*module.get());
-    destination.flush();
+    passManager.run(module);
+    destination.close();
+    if (destination.has_error()) {
+        errorHandler.logError("Could not write object file " + fileName + ": " + destination.error().message());
+        destination.clear_error();
+        return false;
+    }
+    return true;
 }
\ No newline at end of file
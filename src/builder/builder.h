@@ -1,15 +1,35 @@
 #pragma once
 
 #include <memory>
+#include <string>
+
+#include "error/errorHandler.h"
+#include "options/options.h"
 
 #include "llvm/IR/Module.h"
 #include "llvm/Target/TargetMachine.h"
 
+// Owns everything needed to turn modules into target code
+//  - meant to be created once and reused for every module, target machines aren't
+//    thread safe though so parallel builds need one of these per thread
 class TargetBuilder {
     std::string mTargetTriple = "";
-    llvm::TargetMachine* mTargetMachine = nullptr;
+    std::unique_ptr<llvm::TargetMachine> mTargetMachine;
 public:
-    TargetBuilder();
+    TargetBuilder(const BuildOptions& options, ErrorHandler& errorHandler);
+
+    // replaces a "native" cpu with the actual host cpu name and features
+    //  - done once up front so the codegen and the target machine agree on the target
+    static void resolveNativeTarget(BuildOptions& options);
+    // target registration is global to the process, so it only has to (and only safely can) happen once
+    static void initializeTargets();
+    static llvm::CodeGenOpt::Level getCodeGenOptLevel(OptimizationLevel level);
+    // shared with the JIT so both compile the same way
+    static llvm::TargetOptions getTargetOptions(const BuildOptions& options);
+
+    llvm::TargetMachine* getTargetMachine() const;
 
-    bool buildModule(std::unique_ptr<llvm::Module>& module, const std::string& fileName);
+    void prepareModule(llvm::Module& module) const;
+    // failures are logged to the given handler, builders are shared between files so each call passes the handler of its file
+    bool buildModule(llvm::Module& module, const std::string& fileName, ErrorHandler& errorHandler);
 };
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "buildCache.h"
+
+#include <string>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+
+// set by the build, anything that changes the generated code needs a new version so old entries stop matching
+#ifndef VELVET_VERSION
+#define VELVET_VERSION "unknown"
+#endif
+
+namespace {
+    // modules that weren't given a key keep the identifier from codegen, which must never be looked up
+    bool _isCacheKey(llvm::StringRef identifier) {
+        constexpr size_t keyLength = 40;
+        return identifier.size() == keyLength && identifier.find_first_not_of("0123456789abcdef") == llvm::StringRef::npos;
+    }
+}
+
+BuildCache::BuildCache(const std::string& directory)
+    : mDirectory(directory)
+{
+    // if this fails every lookup misses and every store is dropped, which just means nothing is cached
+    llvm::sys::fs::create_directories(mDirectory);
+}
+
+std::string BuildCache::computeKey(llvm::StringRef contents, const BuildOptions& options) {
+    std::string keyData = std::string(VELVET_VERSION) + '\0' + LLVM_VERSION_STRING + '\0';
+    keyData += std::string(options.mRunJIT ? "jit" : "object") + '\0';
+    // link time optimized builds cache pre link bitcode instead of finished code
+    keyData += std::string(options.mLinkTimeOptimization ? "lto" : "") + '\0';
+    keyData += std::to_string(static_cast<int>(options.mOptimizationLevel)) + '\0';
+    keyData += options.mTargetCPU + '\0' + options.mTargetFeatures + '\0';
+    keyData += std::to_string(options.mCodegenPartitions) + '\0';
+    keyData += std::string(options.mFastMath ? "fastmath" : "") + '\0' + (options.mContractFloatOps ? "contract" : "") + '\0';
+    // both are baked into the runtime calls of parallel loops
+    keyData += std::to_string(options.mParallelGrainSize) + '\0' + (options.mDeterministicParallel ? "deterministic" : "") + '\0';
+    keyData += contents.str();
+    return llvm::toHex(llvm::SHA1::hash(llvm::arrayRefFromStringRef(keyData)), true);
+}
+
+std::string BuildCache::getPartitionKey(const std::string& key, unsigned int partition) {
+    if (partition == 0) {
+        return key;
+    }
+    const std::string keyData = key + '\0' + std::to_string(partition);
+    return llvm::toHex(llvm::SHA1::hash(llvm::arrayRefFromStringRef(keyData)), true);
+}
+
+std::unique_ptr<llvm::MemoryBuffer> BuildCache::lookup(const std::string& key) const {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> object = llvm::MemoryBuffer::getFile(_getEntryPath(key), false, false);
+    if (!object) {
+        return nullptr;
+    }
+    return std::move(object.get());
+}
+
+void BuildCache::store(const std::string& key, llvm::MemoryBufferRef object) const {
+    const std::string entryPath = _getEntryPath(key);
+    llvm::SmallString<128> tempPath;
+    int fileDescriptor = 0;
+    if (llvm::sys::fs::createUniqueFile(entryPath + "-%%%%%%.tmp", fileDescriptor, tempPath)) {
+        return;
+    }
+    llvm::raw_fd_ostream output(fileDescriptor, true);
+    output << object.getBuffer();
+    output.close();
+    // a partially written entry would be picked up as a valid object by the next build
+    if (output.has_error()) {
+        output.clear_error();
+        llvm::sys::fs::remove(tempPath);
+        return;
+    }
+    if (llvm::sys::fs::rename(tempPath, entryPath)) {
+        llvm::sys::fs::remove(tempPath);
+    }
+}
+
+void BuildCache::notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object) {
+    if (_isCacheKey(module->getModuleIdentifier())) {
+        store(module->getModuleIdentifier(), object);
+    }
+}
+
+std::unique_ptr<llvm::MemoryBuffer> BuildCache::getObject(const llvm::Module* module) {
+    if (!_isCacheKey(module->getModuleIdentifier())) {
+        return nullptr;
+    }
+    return lookup(module->getModuleIdentifier());
+}
+
+std::string BuildCache::_getEntryPath(const std::string& key) const {
+    llvm::SmallString<128> path(mDirectory);
+    llvm::sys::path::append(path, key + ".o");
+    return path.str().str();
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "options/options.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+// Persistent cache of compiled object files, keyed by everything that can change the generated code
+//  - entries are plain object files named after their key, so the directory can be deleted at any time
+//  - entries are written to a unique temporary file and renamed into place, so parallel builds can share it
+//  - failing to read or write the cache is never an error, the file just gets compiled again
+class BuildCache : public llvm::ObjectCache {
+    std::string mDirectory;
+public:
+    explicit BuildCache(const std::string& directory);
+
+    // hash of the source together with the compiler version and every option that affects codegen
+    //  - the JIT and the object file path don't generate the same code, so they get separate entries
+    static std::string computeKey(llvm::StringRef contents, const BuildOptions& options);
+    // files split into several partitions store one entry per partition, the first one uses the file's key
+    static std::string getPartitionKey(const std::string& key, unsigned int partition);
+
+    // returns nullptr on a cache miss
+    std::unique_ptr<llvm::MemoryBuffer> lookup(const std::string& key) const;
+    void store(const std::string& key, llvm::MemoryBufferRef object) const;
+
+    // lets the JIT use the cache as well, modules are expected to have their cache key as the module identifier
+    void notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object) override;
+    std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module* module) override;
+private:
+    std::string _getEntryPath(const std::string& key) const;
+};
\ No newline at end of file
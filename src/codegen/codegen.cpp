@@ -1,9 +1,193 @@
 #include "codegen.h"
 
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/Verifier.h"
 
 #include <iostream>
 
+namespace {
+    // conservatively checks if an array could be modified anywhere in an expression
+    //  - ignores scoping, any assignment to or decay of an array with the same symbol counts
+    bool _isArrayWritten(ExpressionNodeRef& expressionNode, SymbolId symbol);
+
+    bool _isArrayWritten(NodeList& expressions, SymbolId symbol) {
+        for (ExpressionNodeRef& expression : expressions) {
+            if (_isArrayWritten(expression, symbol)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool _isArrayWritten(VariableAccessNode& varAccess, SymbolId symbol) {
+        // decayed arrays can be written through by whatever function they're passed to
+        if (varAccess.mArrayDecay && varAccess.mName.mSymbol == symbol) {
+            return true;
+        }
+        if (varAccess.mArrayIndices.has_value() && _isArrayWritten(varAccess.mArrayIndices.value(), symbol)) {
+            return true;
+        }
+        return varAccess.mCallArgs.has_value() && _isArrayWritten(varAccess.mCallArgs.value(), symbol);
+    }
+
+    bool _isArrayWritten(ForNode& forLoop, SymbolId symbol) {
+        return _isArrayWritten(forLoop.mStart, symbol) || _isArrayWritten(forLoop.mEnd, symbol) || _isArrayWritten(forLoop.mExpressionList, symbol);
+    }
+
+    bool _isArrayWritten(ExpressionNodeRef& expressionNode, SymbolId symbol) {
+        if (auto variable = std::get_if<VariableAccessNode*>(&expressionNode)) {
+            return *variable && _isArrayWritten(**variable, symbol);
+        }
+        if (auto scope = std::get_if<ScopeNode*>(&expressionNode)) {
+            return *scope && _isArrayWritten((*scope)->mExpressionList, symbol);
+        }
+        if (auto arrayValue = std::get_if<ArrayValueNode*>(&expressionNode)) {
+            return *arrayValue && _isArrayWritten((*arrayValue)->mExpressionList, symbol);
+        }
+        if (auto vectorValue = std::get_if<VectorValueNode*>(&expressionNode)) {
+            if (!*vectorValue) {
+                return false;
+            }
+            // a decayed element passed straight to a vector value is only loaded from, so only its indices matter
+            for (ExpressionNodeRef& argument : (*vectorValue)->mArguments) {
+                auto variable = std::get_if<VariableAccessNode*>(&argument);
+                const bool isLoad = variable && *variable && (*variable)->mArrayDecay && (*variable)->mArrayIndices.has_value();
+                if (isLoad ? _isArrayWritten((*variable)->mArrayIndices.value(), symbol) : _isArrayWritten(argument, symbol)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        if (auto conditional = std::get_if<ConditionalNode*>(&expressionNode)) {
+            if (!*conditional) {
+                return false;
+            }
+            ConditionalNode& node = **conditional;
+            return _isArrayWritten(node.mCondition, symbol) || _isArrayWritten(node.mThen, symbol) 
+                || (node.mElse.has_value() && _isArrayWritten(node.mElse.value(), symbol));
+        }
+        if (auto binop = std::get_if<BinaryOperationNode*>(&expressionNode)) {
+            return *binop && (_isArrayWritten((*binop)->mLeft, symbol) || _isArrayWritten((*binop)->mRight, symbol));
+        }
+        if (auto vardef = std::get_if<VariableDefinitionNode*>(&expressionNode)) {
+            return *vardef && (*vardef)->mInitialValue.has_value() && _isArrayWritten((*vardef)->mInitialValue.value(), symbol);
+        }
+        if (auto assign = std::get_if<AssignmentNode*>(&expressionNode)) {
+            if (!*assign) {
+                return false;
+            }
+            VariableAccessNode& target = (*assign)->mVariable.mVariable;
+            return target.mName.mSymbol == symbol || _isArrayWritten(target, symbol) || _isArrayWritten((*assign)->mValue, symbol);
+        }
+        if (auto loop = std::get_if<LoopNode*>(&expressionNode)) {
+            return *loop && _isArrayWritten((*loop)->mExpressionList, symbol);
+        }
+        if (auto forLoop = std::get_if<ForNode*>(&expressionNode)) {
+            return *forLoop && _isArrayWritten(**forLoop, symbol);
+        }
+        if (auto reduce = std::get_if<ReduceNode*>(&expressionNode)) {
+            return *reduce && _isArrayWritten((*reduce)->mLoop, symbol);
+        }
+        // numbers and breaks can't write anything
+        return false;
+    }
+
+    // marks every symbol an expression refers to, whether it's read, written or called
+    void _collectSymbols(ExpressionNodeRef& expressionNode, std::vector<bool>& usedSymbols);
+
+    void _markSymbol(const IdentifierNode& name, std::vector<bool>& usedSymbols) {
+        if (name.mSymbol < usedSymbols.size()) {
+            usedSymbols[name.mSymbol] = true;
+        }
+    }
+
+    void _collectSymbols(NodeList& expressions, std::vector<bool>& usedSymbols) {
+        for (ExpressionNodeRef& expression : expressions) {
+            _collectSymbols(expression, usedSymbols);
+        }
+    }
+
+    void _collectSymbols(VariableAccessNode& varAccess, std::vector<bool>& usedSymbols) {
+        _markSymbol(varAccess.mName, usedSymbols);
+        if (varAccess.mArrayIndices.has_value()) {
+            _collectSymbols(varAccess.mArrayIndices.value(), usedSymbols);
+        }
+        if (varAccess.mCallArgs.has_value()) {
+            _collectSymbols(varAccess.mCallArgs.value(), usedSymbols);
+        }
+    }
+
+    void _collectSymbols(ForNode& forLoop, std::vector<bool>& usedSymbols) {
+        _collectSymbols(forLoop.mStart, usedSymbols);
+        _collectSymbols(forLoop.mEnd, usedSymbols);
+        _collectSymbols(forLoop.mExpressionList, usedSymbols);
+    }
+
+    void _collectSymbols(ExpressionNodeRef& expressionNode, std::vector<bool>& usedSymbols) {
+        if (auto variable = std::get_if<VariableAccessNode*>(&expressionNode)) {
+            if (*variable) {
+                _collectSymbols(**variable, usedSymbols);
+            }
+        }
+        else if (auto scope = std::get_if<ScopeNode*>(&expressionNode)) {
+            if (*scope) {
+                _collectSymbols((*scope)->mExpressionList, usedSymbols);
+            }
+        }
+        else if (auto arrayValue = std::get_if<ArrayValueNode*>(&expressionNode)) {
+            if (*arrayValue) {
+                _collectSymbols((*arrayValue)->mExpressionList, usedSymbols);
+            }
+        }
+        else if (auto vectorValue = std::get_if<VectorValueNode*>(&expressionNode)) {
+            if (*vectorValue) {
+                _collectSymbols((*vectorValue)->mArguments, usedSymbols);
+            }
+        }
+        else if (auto conditional = std::get_if<ConditionalNode*>(&expressionNode)) {
+            if (*conditional) {
+                _collectSymbols((*conditional)->mCondition, usedSymbols);
+                _collectSymbols((*conditional)->mThen, usedSymbols);
+                if ((*conditional)->mElse.has_value()) {
+                    _collectSymbols((*conditional)->mElse.value(), usedSymbols);
+                }
+            }
+        }
+        else if (auto binop = std::get_if<BinaryOperationNode*>(&expressionNode)) {
+            if (*binop) {
+                _collectSymbols((*binop)->mLeft, usedSymbols);
+                _collectSymbols((*binop)->mRight, usedSymbols);
+            }
+        }
+        else if (auto vardef = std::get_if<VariableDefinitionNode*>(&expressionNode)) {
+            if (*vardef && (*vardef)->mInitialValue.has_value()) {
+                _collectSymbols((*vardef)->mInitialValue.value(), usedSymbols);
+            }
+        }
+        else if (auto assign = std::get_if<AssignmentNode*>(&expressionNode)) {
+            if (*assign) {
+                _collectSymbols((*assign)->mVariable.mVariable, usedSymbols);
+                _collectSymbols((*assign)->mValue, usedSymbols);
+            }
+        }
+        else if (auto loop = std::get_if<LoopNode*>(&expressionNode)) {
+            if (*loop) {
+                _collectSymbols((*loop)->mExpressionList, usedSymbols);
+            }
+        }
+        else if (auto forLoop = std::get_if<ForNode*>(&expressionNode)) {
+            if (*forLoop) {
+                _collectSymbols(**forLoop, usedSymbols);
+            }
+        }
+        else if (auto reduce = std::get_if<ReduceNode*>(&expressionNode)) {
+            if (*reduce) {
+                _collectSymbols((*reduce)->mLoop, usedSymbols);
+            }
+        }
+    }
+}
+
 llvm::Type* CodeGenerator::_getRawLLVMType(Token type) const {
     if (type == Token::TYPE_I32) {
         return llvm::Type::getInt32Ty(*mContext);
@@ -14,16 +198,27 @@ llvm::Type* CodeGenerator::_getRawLLVMType(Token type) const {
     if (type == Token::TYPE_BOOL) {
         return llvm::Type::getInt1Ty(*mContext);
     }
+    if (type == Token::TYPE_F32X4) {
+        return llvm::FixedVectorType::get(llvm::Type::getFloatTy(*mContext), 4);
+    }
+    if (type == Token::TYPE_F32X8) {
+        return llvm::FixedVectorType::get(llvm::Type::getFloatTy(*mContext), 8);
+    }
+    if (type == Token::TYPE_I32X8) {
+        return llvm::FixedVectorType::get(llvm::Type::getInt32Ty(*mContext), 8);
+    }
     mErrorHandler.logError("No corresponding LLVM type could be found");
     return nullptr;
 }
 
-CodeGenerator::CodeGenerator(ErrorHandler& handler) 
+CodeGenerator::CodeGenerator(ErrorHandler& handler, const BuildOptions& options, const IdentifierTable& identifiers) 
     : mContext(std::make_unique<llvm::LLVMContext>())
     , mModule(std::make_unique<llvm::Module>("velvet", *mContext))
     , mBuilder(std::make_unique<llvm::IRBuilder<>>(*mContext)) 
     , mErrorHandler(handler)
-    , mSymbolStack()
+    , mOptions(options)
+    , mIdentifiers(identifiers)
+    , mSymbolBindings()
     , mFunctions()
     , mLoopStack() 
 {
@@ -47,51 +242,85 @@ void CodeGenerator::setupDefaultFunctions() {
     llvm::FunctionType* printfType = llvm::FunctionType::get(
         llvm::IntegerType::getInt32Ty(*mContext),
         llvm::PointerType::get(llvm::Type::getInt8Ty(*mContext), 0), true);
-    mFunctions["printf"] = llvm::Function::Create(printfType, llvm::Function::ExternalLinkage, "printf", *mModule);
+    // the parser is done with the table by now, so every id codegen will ever see exists already
+    mVisibleBindings.assign(mIdentifiers.size(), noBinding);
+    mFunctions.assign(mIdentifiers.size(), nullptr);
+    llvm::Function* printf = llvm::Function::Create(printfType, llvm::Function::ExternalLinkage, "printf", *mModule);
+    // a source that never mentions printf has no symbol for it, and can't call it either
+    mPrintfSymbol = mIdentifiers.find("printf");
+    if (mPrintfSymbol != invalidSymbol) {
+        mFunctions[mPrintfSymbol] = printf;
+    }
+    const std::pair<std::string_view, ReductionKind> laneReductions[] = {
+        { "hadd", ReductionKind::ADD },
+        { "hmul", ReductionKind::MUL },
+        { "hmin", ReductionKind::MIN },
+        { "hmax", ReductionKind::MAX }
+    };
+    for (const auto& [name, reduction] : laneReductions) {
+        const SymbolId symbol = mIdentifiers.find(name);
+        if (symbol != invalidSymbol) {
+            mLaneReductionSymbols.emplace_back(symbol, reduction);
+        }
+    }
 }
 
 // can the passed in expression owner be const ref?
-llvm::Value* CodeGenerator::generateExpressionCode(ExpressionNodeOwner& expressionNode) {
-    if (auto variable = std::get_if<std::unique_ptr<VariableAccessNode>>(&expressionNode)) {
+llvm::Value* CodeGenerator::generateExpressionCode(ExpressionNodeRef& expressionNode) {
+    if (auto variable = std::get_if<VariableAccessNode*>(&expressionNode)) {
         return _generateVariableAccess(*variable);
     }
-    if (auto number = std::get_if<std::unique_ptr<NumberNode>>(&expressionNode)) {
+    if (auto number = std::get_if<NumberNode*>(&expressionNode)) {
         return _generateNumber(*number);
     }
-    if (auto scope = std::get_if<std::unique_ptr<ScopeNode>>(&expressionNode)) {
+    if (auto scope = std::get_if<ScopeNode*>(&expressionNode)) {
         return _generateScope(*scope); 
     }
-    if (auto arrayValue = std::get_if<std::unique_ptr<ArrayValueNode>>(&expressionNode)) {
+    if (auto arrayValue = std::get_if<ArrayValueNode*>(&expressionNode)) {
         // This is actually not implemented, needs special case to codegen
         return nullptr;
     }
-    if (auto conditional = std::get_if<std::unique_ptr<ConditionalNode>>(&expressionNode)) {
+    if (auto vectorValue = std::get_if<VectorValueNode*>(&expressionNode)) {
+        return _generateVectorValue(*vectorValue);
+    }
+    if (auto conditional = std::get_if<ConditionalNode*>(&expressionNode)) {
         return _generateConditional(*conditional);
     }
-    if (auto binop = std::get_if<std::unique_ptr<BinaryOperationNode>>(&expressionNode)) {
+    if (auto binop = std::get_if<BinaryOperationNode*>(&expressionNode)) {
         return _generateBinaryOperation(*binop);
     }
-    if (auto vardef = std::get_if<std::unique_ptr<VariableDefinitionNode>>(&expressionNode)) {
+    if (auto vardef = std::get_if<VariableDefinitionNode*>(&expressionNode)) {
         return _generateVariableDefinition(*vardef);
     }
-    if (auto assign = std::get_if<std::unique_ptr<AssignmentNode>>(&expressionNode)) {
+    if (auto assign = std::get_if<AssignmentNode*>(&expressionNode)) {
         return _generateAssignment(*assign);
     }
-    if (auto loop = std::get_if<std::unique_ptr<LoopNode>>(&expressionNode)) {
+    if (auto loop = std::get_if<LoopNode*>(&expressionNode)) {
         return _generateLoop(*loop);
     }
-    if (auto br = std::get_if<std::unique_ptr<BreakNode>>(&expressionNode)) {
+    if (auto forLoop = std::get_if<ForNode*>(&expressionNode)) {
+        return _generateFor(*forLoop);
+    }
+    if (auto reduce = std::get_if<ReduceNode*>(&expressionNode)) {
+        return _generateReduce(*reduce);
+    }
+    if (auto br = std::get_if<BreakNode*>(&expressionNode)) {
         return _generateBreak(*br);
     }
     mErrorHandler.logError("No valid expression was generated");
     return nullptr;
 }
 
-llvm::Function* CodeGenerator::generateFunctionCode(FunctionDefinitionNode& functionDefinition) {
-    if (mFunctions.find(functionDefinition.mName.mIdentifier) != mFunctions.end()) {
+llvm::Function* CodeGenerator::declareFunction(FunctionDefinitionNode& functionDefinition) {
+    const SymbolId functionSymbol = functionDefinition.mName.mSymbol;
+    if (_getFunction(functionSymbol)) {
         mErrorHandler.logError("Function already exists");
         return nullptr;
     }
+    if (functionSymbol >= mFunctions.size()) {
+        mErrorHandler.logError("Unknown symbol for function " + std::string(functionDefinition.mName.mIdentifier));
+        return nullptr;
+    }
     std::vector<llvm::Type*> argumentTypes = std::vector<llvm::Type*>();
     argumentTypes.reserve(functionDefinition.mArguments.size());
     for (auto& argument : functionDefinition.mArguments) {
@@ -124,13 +353,60 @@ llvm::Function* CodeGenerator::generateFunctionCode(FunctionDefinitionNode& func
         mErrorHandler.logError("Could not generate function");
         return nullptr;
     }
+    _addFunctionAttributes(func, functionDefinition);
+    mFunctions[functionSymbol] = func;
+    return func;
+}
+
+void CodeGenerator::_addFunctionAttributes(llvm::Function* func, const FunctionDefinitionNode& functionDefinition) {
+    // let the function level passes (e.g. the vectorizers) know what the target supports
+    func->addFnAttr("target-cpu", mOptions.mTargetCPU);
+    if (!mOptions.mTargetFeatures.empty()) {
+        func->addFnAttr("target-features", mOptions.mTargetFeatures);
+    }
+    // same attributes clang sets for -ffast-math, some passes (e.g. min/max reductions in the loop vectorizer) and the
+    //  backend go by these rather than the flags on each instruction
+    if (_getFastMathFlags(functionDefinition).isFast()) {
+        for (const char* attribute : { "unsafe-fp-math", "no-infs-fp-math", "no-nans-fp-math", "no-signed-zeros-fp-math", "approx-func-fp-math" }) {
+            func->addFnAttr(attribute, "true");
+        }
+    }
+}
+
+llvm::FastMathFlags CodeGenerator::_getFastMathFlags(const FunctionDefinitionNode& functionDefinition) const {
+    llvm::FastMathFlags flags;
+    if (functionDefinition.mFastMath || mOptions.mFastMath) {
+        flags.setFast();
+    }
+    else if (functionDefinition.mContract || mOptions.mContractFloatOps) {
+        flags.setAllowContract();
+    }
+    return flags;
+}
+
+llvm::Function* CodeGenerator::generateFunctionCode(FunctionDefinitionNode& functionDefinition) {
+    llvm::Function* func = _getFunction(functionDefinition.mName.mSymbol);
+    if (!func) {
+        func = declareFunction(functionDefinition);
+        if (!func) {
+            return nullptr;
+        }
+    }
+    else if (!func->empty()) {
+        mErrorHandler.logError("Function already exists");
+        return nullptr;
+    }
+    mCurrentFunction = &functionDefinition;
+    // every float operation the builder creates for this function picks these up
+    mBuilder->setFastMathFlags(_getFastMathFlags(functionDefinition));
     _pushNewSymbolScope();
     llvm::BasicBlock* basicBlock = llvm::BasicBlock::Create(*mContext, "entry", func);
     mBuilder->SetInsertPoint(basicBlock);
+    _sealBlock(basicBlock);
     size_t index = 0;
     for (auto& argument : func->args()) {
         const auto& argumentDefinition = functionDefinition.mArguments[index]; 
-        argument.setName(argumentDefinition.first);
+        argument.setName(argumentDefinition.first.mIdentifier);
         // TODO: Is there a way to share code with loop above?
         llvm::Type* type = _getRawLLVMType(argumentDefinition.second.mRawType);
         std::vector<size_t> arraySize;
@@ -146,9 +422,16 @@ llvm::Function* CodeGenerator::generateFunctionCode(FunctionDefinitionNode& func
                 }
             }
         }
-        llvm::AllocaInst* alloca = mBuilder->CreateAlloca(type, nullptr, argumentDefinition.first);
-        mBuilder->CreateStore(&argument, alloca);
-        _addSymbolData(argumentDefinition.first, alloca, argumentDefinition.second.mRawType, argumentDefinition.second.mIsArrayDecay, arraySize);
+        // arrays passed by value need memory to index into, everything else can live in a register
+        if (arraySize.empty()) {
+            _addRegisterSymbolData(argumentDefinition.first, type, argumentDefinition.second.mRawType, argumentDefinition.second.mIsArrayDecay);
+            _writeRegister(mRegisters.size() - 1, basicBlock, &argument);
+        }
+        else {
+            llvm::AllocaInst* alloca = _createEntryBlockAlloca(type, argumentDefinition.first.mIdentifier);
+            mBuilder->CreateStore(&argument, alloca);
+            _addSymbolData(argumentDefinition.first, alloca, type, argumentDefinition.second.mRawType, argumentDefinition.second.mIsArrayDecay, arraySize);
+        }
         index++;
     }
     llvm::Value* returnValue = generateExpressionCode(functionDefinition.mExpression);
@@ -159,8 +442,12 @@ llvm::Function* CodeGenerator::generateFunctionCode(FunctionDefinitionNode& func
     }
     mBuilder->CreateRet(returnValue);
     _popSymbolScope();
+    // SSA bookkeeping is per function, blocks are never revisited once the function is done
+    mRegisters.clear();
+    mCurrentDefinitions.clear();
+    mIncompletePhis.clear();
+    mSealedBlocks.clear();
     llvm::verifyFunction(*func);
-    mFunctions[functionDefinition.mName.mIdentifier] = func;
     return func;
 }
 
@@ -168,39 +455,66 @@ std::unique_ptr<llvm::Module>& CodeGenerator::getModule() {
     return mModule;
 }
 
-llvm::Value* CodeGenerator::_generateVariableAccess(std::unique_ptr<VariableAccessNode>& varAccess) {
-    const std::string& varName = varAccess->mName.mIdentifier;
-    llvm::Value* memLocation = _getMemLocationFromVariableAccess(*varAccess.get());
-    if (memLocation) {
-        llvm::Type* elementType = _getRawLLVMType(_getSymbolData(varName).value()->mRawType);
-        // Handle special case of decaying an array to a pointer
-        //  - perhaps this would be better handled by a completely different type of "node"
-        if (varAccess->mArrayDecay) {
-            // TODO: Avoid extra work of finding symbol data twice, can do outside and pass to function
-            std::optional<VariableInfo*> symbolData = _getSymbolData(varName);
-            if (symbolData.has_value()) {
-                llvm::AllocaInst* alloca = symbolData.value()->mAlloca;
+std::unique_ptr<llvm::LLVMContext>& CodeGenerator::getContext() {
+    return mContext;
+}
+
+llvm::Value* CodeGenerator::_generateVariableAccess(VariableAccessNode* varAccess) {
+    const SymbolId symbol = varAccess->mName.mSymbol;
+    std::optional<VariableInfo*> symbolData = _getSymbolData(symbol);
+    if (symbolData.has_value()) {
+        VariableInfo* varInfo = symbolData.value();
+        if (varInfo->mInductionValue && !varAccess->mArrayIndices.has_value()) {
+            return mBuilder->CreateTrunc(varInfo->mInductionValue, llvm::Type::getInt32Ty(*mContext), varAccess->mName.mIdentifier);
+        }
+        if (varInfo->mRegisterType && !varAccess->mArrayIndices.has_value()) {
+            // decaying an array that is already decayed is just the pointer itself
+            return _readRegister(varInfo->mRegisterId, mBuilder->GetInsertBlock());
+        }
+        if (varInfo->mRegisterType && varInfo->mRegisterType->isVectorTy()) {
+            // indexing a vector picks out a single lane
+            const size_t registerId = varInfo->mRegisterId;
+            llvm::Value* lane = _generateLaneIndex(*varAccess);
+            if (!lane) {
+                return nullptr;
+            }
+            return mBuilder->CreateExtractElement(_readRegister(registerId, mBuilder->GetInsertBlock()), lane, varAccess->mName.mIdentifier);
+        }
+        // the index expressions can define new symbols, which may move the symbol data, so copy out what's needed first
+        llvm::Type* elementType = _getRawLLVMType(varInfo->mRawType);
+        llvm::Type* memoryType = varInfo->mMemoryType;
+        llvm::Value* memory = varInfo->mMemory;
+        llvm::Value* memLocation = _getMemLocationFromVariableAccess(*varAccess);
+        if (memLocation) {
+            // Handle special case of decaying an array to a pointer
+            //  - perhaps this would be better handled by a completely different type of "node"
+            //  - decaying an indexed element gives its address, which is how vectors are loaded from the middle of an array
+            if (varAccess->mArrayDecay && varAccess->mArrayIndices.has_value()) {
+                return memLocation;
+            }
+            if (varAccess->mArrayDecay) {
                 llvm::ConstantInt* zero = llvm::ConstantInt::get(llvm::Type::getInt32Ty(*mContext), 0);
                 llvm::Value* indices[] = { zero, zero };
-                return mBuilder->CreateGEP(alloca->getAllocatedType(), alloca, indices, "arrdecay");
+                return mBuilder->CreateGEP(memoryType, memory, indices, "arrdecay");
             }
-        }
-        else {
-            return mBuilder->CreateLoad(elementType, memLocation, varName);
+            return mBuilder->CreateLoad(elementType, memLocation, varAccess->mName.mIdentifier);
         }
     }
-    auto funcIt = mFunctions.find(varName);
-    if (funcIt != mFunctions.end()) {
+    if (llvm::Function* function = _getFunction(symbol)) {
         // Special cases
-        if (funcIt->first == "printf") {
+        if (symbol == mPrintfSymbol) {
             if (varAccess->mCallArgs.has_value()) {
-                std::vector<ExpressionNodeOwner>& argExpressions = varAccess->mCallArgs.value();
+                NodeList& argExpressions = varAccess->mCallArgs.value();
                 if (argExpressions.empty()) {
                     mErrorHandler.logError("Print statement should always have an argument");
                     return nullptr;
                 }
                 llvm::Value* formatString = nullptr;
-                llvm::Value* value = generateExpressionCode(argExpressions.front());
+                llvm::Value* value = generateExpressionCode(argExpressions[0]);
+                if (!value || value->getType()->isVectorTy()) {
+                    mErrorHandler.logError("Print statement only takes a single scalar value");
+                    return nullptr;
+                }
                 if (value->getType()->isFloatTy()) {
                     formatString = mBuilder->CreateGlobalStringPtr("%f\n", "formatStringf");
                     // float needs to be promoted to a double to work with printf
@@ -209,7 +523,7 @@ llvm::Value* CodeGenerator::_generateVariableAccess(std::unique_ptr<VariableAcce
                     formatString = mBuilder->CreateGlobalStringPtr("%d\n", "formatStringd");
                 }
                 llvm::Value* printfArgs[] = { formatString, value };
-                return mBuilder->CreateCall(mFunctions["printf"], printfArgs, "calltmp");
+                return mBuilder->CreateCall(function, printfArgs, "calltmp");
             }
             else {
                 mErrorHandler.logError("Print statement should always have an argument");
@@ -217,32 +531,34 @@ llvm::Value* CodeGenerator::_generateVariableAccess(std::unique_ptr<VariableAcce
             }
         }
         if (varAccess->mCallArgs.has_value()) {
-            std::vector<ExpressionNodeOwner>& argExpressions = varAccess->mCallArgs.value();
-            auto it = mFunctions.find(varName);
-            if (it == mFunctions.end()) {
-                mErrorHandler.logError("Could not find function");
-                return nullptr;
-            }
-            if (it->second->arg_size() != argExpressions.size()) {
+            NodeList& argExpressions = varAccess->mCallArgs.value();
+            if (function->arg_size() != argExpressions.size()) {
                 mErrorHandler.logError("Mismatched number of function arguments");
                 return nullptr;
             }
             std::vector<llvm::Value*> values;
-            for (ExpressionNodeOwner& expr : argExpressions) {
+            for (ExpressionNodeRef& expr : argExpressions) {
                 values.emplace_back(generateExpressionCode(expr));
             }
-            return mBuilder->CreateCall(it->second, values, "calltmp");
+            return mBuilder->CreateCall(function, values, "calltmp");
         }
         else {
             mErrorHandler.logError("Expected argument list after function call");
             return nullptr;
         }
     }
+    if (varAccess->mCallArgs.has_value()) {
+        for (const auto& [laneSymbol, reduction] : mLaneReductionSymbols) {
+            if (laneSymbol == symbol) {
+                return _generateLaneReduction(reduction, varAccess->mCallArgs.value());
+            }
+        }
+    }
     mErrorHandler.logError("Could not find existing symbol for identifier");
     return nullptr;
 }
 
-llvm::Value* CodeGenerator::_generateNumber(std::unique_ptr<NumberNode>& number) {
+llvm::Value* CodeGenerator::_generateNumber(NumberNode* number) {
     if (float* num = std::get_if<float>(&number->mNumber)) {
         return llvm::ConstantFP::get(*mContext, llvm::APFloat(*num));
     }
@@ -253,10 +569,10 @@ llvm::Value* CodeGenerator::_generateNumber(std::unique_ptr<NumberNode>& number)
     return nullptr;
 }
 
-llvm::Value* CodeGenerator::_generateScope(std::unique_ptr<ScopeNode>& scope) {
+llvm::Value* CodeGenerator::_generateScope(ScopeNode* scope) {
     _pushNewSymbolScope();
     llvm::Value* last = nullptr;
-    for (ExpressionNodeOwner& expression : scope->mExpressionList) {
+    for (ExpressionNodeRef& expression : scope->mExpressionList) {
         last = generateExpressionCode(expression);
     }
     _popSymbolScope();
@@ -264,17 +580,17 @@ llvm::Value* CodeGenerator::_generateScope(std::unique_ptr<ScopeNode>& scope) {
     return last;   
 }
 
-llvm::Value* CodeGenerator::_generateArrayValue(std::unique_ptr<ArrayValueNode>& arrayValue, llvm::AllocaInst* alloca) {
+llvm::Value* CodeGenerator::_generateArrayValue(ArrayValueNode* arrayValue, llvm::AllocaInst* alloca) {
     llvm::Type* type = alloca->getAllocatedType();
     llvm::Type* elementType = type->getArrayElementType();
     llvm::ConstantInt* zero = llvm::ConstantInt::get(llvm::Type::getInt32Ty(*mContext), 0);
     std::vector<llvm::Value*> indexStack = { zero };
-    std::function<void(std::unique_ptr<ArrayValueNode>&)> visitArrayExpressions = [&indexStack, &visitArrayExpressions, this, type, alloca](std::unique_ptr<ArrayValueNode>& arrayValue) {
+    std::function<void(ArrayValueNode*)> visitArrayExpressions = [&indexStack, &visitArrayExpressions, this, type, alloca](ArrayValueNode* arrayValue) {
         int index = 0;
-        for (ExpressionNodeOwner& expr : arrayValue->mExpressionList) {
+        for (ExpressionNodeRef& expr : arrayValue->mExpressionList) {
             llvm::Value* indexExpr = llvm::ConstantInt::get(llvm::Type::getInt32Ty(*mContext), index);
             indexStack.push_back(indexExpr);
-            if (auto subArrayValue = std::get_if<std::unique_ptr<ArrayValueNode>>(&expr)) {
+            if (auto subArrayValue = std::get_if<ArrayValueNode*>(&expr)) {
                 visitArrayExpressions(*subArrayValue);
             }
             else {
@@ -291,7 +607,71 @@ llvm::Value* CodeGenerator::_generateArrayValue(std::unique_ptr<ArrayValueNode>&
     return nullptr;
 }
 
-llvm::Value* CodeGenerator::_generateConditional(std::unique_ptr<ConditionalNode>& conditional) {
+llvm::Value* CodeGenerator::_generateVectorValue(VectorValueNode* vectorValue) {
+    llvm::FixedVectorType* vectorType = llvm::dyn_cast_or_null<llvm::FixedVectorType>(_getRawLLVMType(vectorValue->mType));
+    if (!vectorType) {
+        mErrorHandler.logError("Vector value needs a vector type");
+        return nullptr;
+    }
+    llvm::Type* elementType = vectorType->getElementType();
+    NodeList& arguments = vectorValue->mArguments;
+    if (arguments.size() == 1) {
+        llvm::Value* value = generateExpressionCode(arguments[0]);
+        if (value && value->getType()->isPointerTy()) {
+            // only the element alignment is known, the array doesn't have to be aligned to the whole vector
+            const llvm::Align elementAlign(elementType->getPrimitiveSizeInBits() / 8);
+            return mBuilder->CreateAlignedLoad(vectorType, value, elementAlign, "vecload");
+        }
+        if (value && value->getType() == elementType) {
+            return mBuilder->CreateVectorSplat(vectorType->getNumElements(), value, "splat");
+        }
+        mErrorHandler.logError("Vector value needs a scalar of its element type or a decayed array element");
+        return nullptr;
+    }
+    if (arguments.size() != vectorType->getNumElements()) {
+        mErrorHandler.logError("Vector value needs a single value or one value per lane");
+        return nullptr;
+    }
+    llvm::Value* vector = llvm::UndefValue::get(vectorType);
+    for (size_t lane = 0; lane < arguments.size(); lane++) {
+        llvm::Value* value = generateExpressionCode(arguments[lane]);
+        if (!value || value->getType() != elementType) {
+            mErrorHandler.logError("Vector lane value doesn't match the vector's element type");
+            return nullptr;
+        }
+        vector = mBuilder->CreateInsertElement(vector, value, lane, "vecinit");
+    }
+    return vector;
+}
+
+llvm::Constant* CodeGenerator::_getConstantArrayValue(ArrayValueNode& arrayValue, llvm::Type* type) {
+    llvm::ArrayType* arrayType = llvm::dyn_cast<llvm::ArrayType>(type);
+    if (!arrayType || arrayValue.mExpressionList.size() > arrayType->getNumElements()) {
+        return nullptr;
+    }
+    llvm::Type* elementType = arrayType->getElementType();
+    std::vector<llvm::Constant*> elements;
+    elements.reserve(arrayType->getNumElements());
+    for (ExpressionNodeRef& expr : arrayValue.mExpressionList) {
+        llvm::Constant* element = nullptr;
+        if (auto subArrayValue = std::get_if<ArrayValueNode*>(&expr)) {
+            element = *subArrayValue ? _getConstantArrayValue(**subArrayValue, elementType) : nullptr;
+        }
+        else if (auto number = std::get_if<NumberNode*>(&expr)) {
+            element = *number ? llvm::dyn_cast_or_null<llvm::Constant>(_generateNumber(*number)) : nullptr;
+        }
+        // anything that isn't a literal of the right type has to go through the regular codegen path
+        if (!element || element->getType() != elementType) {
+            return nullptr;
+        }
+        elements.push_back(element);
+    }
+    // elements that weren't given a value are zero initialized
+    elements.resize(arrayType->getNumElements(), llvm::Constant::getNullValue(elementType));
+    return llvm::ConstantArray::get(arrayType, elements);
+}
+
+llvm::Value* CodeGenerator::_generateConditional(ConditionalNode* conditional) {
     llvm::Function* parentFunc = mBuilder->GetInsertBlock()->getParent();
     llvm::Value* conditionValue = generateExpressionCode(conditional->mCondition);
     // we may also want to check that the condition value is a valid boolean typed expression
@@ -305,20 +685,34 @@ llvm::Value* CodeGenerator::_generateConditional(std::unique_ptr<ConditionalNode
     if (conditional->mElse.has_value()) {
         llvm::BasicBlock* elseBlock = llvm::BasicBlock::Create(*mContext, "else", parentFunc, mergeBlock);
         mBuilder->CreateCondBr(conditionValue, thenBlock, elseBlock);
+        _sealBlock(thenBlock);
+        _sealBlock(elseBlock);
         mBuilder->SetInsertPoint(thenBlock);
         llvm::Value* thenValue = generateExpressionCode(conditional->mThen);
-        mBuilder->CreateBr(mergeBlock);
+        // nested expressions can move us into a different block, so the phi has to come from wherever we ended up
+        llvm::BasicBlock* thenEndBlock = mBuilder->GetInsertBlock();
+        const bool thenReachesMerge = !thenEndBlock->getTerminator();
+        if (thenReachesMerge) {
+            mBuilder->CreateBr(mergeBlock);
+        }
         mBuilder->SetInsertPoint(elseBlock);
         llvm::Value* elseValue = generateExpressionCode(conditional->mElse.value());
-        mBuilder->CreateBr(mergeBlock);
-        // TODO: Handle then/else basic blocks changing the actual basic block
-        //  - need to call builder::getInsertBlock to use the newest insert block as then/else
+        llvm::BasicBlock* elseEndBlock = mBuilder->GetInsertBlock();
+        const bool elseReachesMerge = !elseEndBlock->getTerminator();
+        if (elseReachesMerge) {
+            mBuilder->CreateBr(mergeBlock);
+        }
         mBuilder->SetInsertPoint(mergeBlock);
+        _sealBlock(mergeBlock);
         // if statements don't necessarily return a value, only do so if both then/else have return values
-        if (thenValue && elseValue) {
-            llvm::PHINode* phi = mBuilder->CreatePHI(llvm::Type::getDoubleTy(*mContext), 2, "condExprVal");
-            phi->addIncoming(thenValue, thenBlock);
-            phi->addIncoming(elseValue, elseBlock);
+        if (thenValue && elseValue && thenValue->getType() == elseValue->getType() && (thenReachesMerge || elseReachesMerge)) {
+            llvm::PHINode* phi = mBuilder->CreatePHI(thenValue->getType(), 2, "condExprVal");
+            if (thenReachesMerge) {
+                phi->addIncoming(thenValue, thenEndBlock);
+            }
+            if (elseReachesMerge) {
+                phi->addIncoming(elseValue, elseEndBlock);
+            }
             return phi;
         }
         else {
@@ -327,18 +721,20 @@ llvm::Value* CodeGenerator::_generateConditional(std::unique_ptr<ConditionalNode
     }
     else {
         mBuilder->CreateCondBr(conditionValue, thenBlock, mergeBlock);
+        _sealBlock(thenBlock);
         mBuilder->SetInsertPoint(thenBlock);
         llvm::Value* _thenValue = generateExpressionCode(conditional->mThen);
         // If then block is a branch/return we want to not generate this
-        if (!thenBlock->getTerminator()) {
+        if (!mBuilder->GetInsertBlock()->getTerminator()) {
             mBuilder->CreateBr(mergeBlock);
         }
         mBuilder->SetInsertPoint(mergeBlock);
+        _sealBlock(mergeBlock);
         return nullptr;
     }
 }
 
-llvm::Value* CodeGenerator::_generateBinaryOperation(std::unique_ptr<BinaryOperationNode>& binaryOperation) {
+llvm::Value* CodeGenerator::_generateBinaryOperation(BinaryOperationNode* binaryOperation) {
     llvm::Value* left = generateExpressionCode(binaryOperation->mLeft);
     llvm::Value* right = generateExpressionCode(binaryOperation->mRight);
     if (!left || !right) {
@@ -346,14 +742,27 @@ llvm::Value* CodeGenerator::_generateBinaryOperation(std::unique_ptr<BinaryOpera
         mErrorHandler.logError("Unexpected valueless expression in binary operation");
         return nullptr;
     }
+    // a scalar on one side of a vector operation is applied to every lane
+    if (left->getType()->isVectorTy() && right->getType() == left->getType()->getScalarType()) {
+        right = mBuilder->CreateVectorSplat(llvm::cast<llvm::FixedVectorType>(left->getType())->getNumElements(), right, "splat");
+    }
+    else if (right->getType()->isVectorTy() && left->getType() == right->getType()->getScalarType()) {
+        left = mBuilder->CreateVectorSplat(llvm::cast<llvm::FixedVectorType>(right->getType())->getNumElements(), left, "splat");
+    }
     llvm::Type* operationType = left->getType();
     if (operationType != right->getType()) {
         mErrorHandler.logError("Mismatched types in binary operation");
         return nullptr;
     }
+    // lane wise comparisons would give a vector of bools, which nothing can use yet
+    const bool isComparison = binaryOperation->mOperation >= Token::EQUALS && binaryOperation->mOperation <= Token::LESS_EQUALS;
+    if (operationType->isVectorTy() && isComparison) {
+        mErrorHandler.logError("Vector types can't be compared");
+        return nullptr;
+    }
     switch(binaryOperation->mOperation) {
         case Token::PLUS: {
-            if (operationType->isFloatingPointTy()) {
+            if (operationType->isFPOrFPVectorTy()) {
                 return mBuilder->CreateFAdd(left, right, "addtmp");
             }
             else {
@@ -361,7 +770,7 @@ llvm::Value* CodeGenerator::_generateBinaryOperation(std::unique_ptr<BinaryOpera
             }
         } break;
         case Token::MINUS: {
-            if (operationType->isFloatingPointTy()) {
+            if (operationType->isFPOrFPVectorTy()) {
                 return mBuilder->CreateFSub(left, right, "subtmp");
             }
             else {
@@ -369,7 +778,7 @@ llvm::Value* CodeGenerator::_generateBinaryOperation(std::unique_ptr<BinaryOpera
             }
         } break;
         case Token::MULTIPLY: {
-            if (operationType->isFloatingPointTy()) {
+            if (operationType->isFPOrFPVectorTy()) {
                 return mBuilder->CreateFMul(left, right, "multmp");
             }
             else {
@@ -377,7 +786,7 @@ llvm::Value* CodeGenerator::_generateBinaryOperation(std::unique_ptr<BinaryOpera
             }
         } break;
         case Token::DIVIDE: {
-            if (operationType->isFloatingPointTy()) {
+            if (operationType->isFPOrFPVectorTy()) {
                 return mBuilder->CreateFDiv(left, right, "divtmp");
             }
             else {
@@ -386,7 +795,7 @@ llvm::Value* CodeGenerator::_generateBinaryOperation(std::unique_ptr<BinaryOpera
             }
         } break;
         case Token::EQUALS: {
-            if (operationType->isFloatingPointTy()) {
+            if (operationType->isFPOrFPVectorTy()) {
                 return mBuilder->CreateFCmp(llvm::FCmpInst::FCMP_OEQ, left, right, "eqtmp");
             }
             else {
@@ -394,7 +803,7 @@ llvm::Value* CodeGenerator::_generateBinaryOperation(std::unique_ptr<BinaryOpera
             }
         } break;
         case Token::NOT_EQUALS: {
-            if (operationType->isFloatingPointTy()) {
+            if (operationType->isFPOrFPVectorTy()) {
                 return mBuilder->CreateFCmp(llvm::FCmpInst::FCMP_ONE, left, right, "neqtmp");
             }
             else {
@@ -402,7 +811,7 @@ llvm::Value* CodeGenerator::_generateBinaryOperation(std::unique_ptr<BinaryOpera
             }
         } break;
         case Token::GREATER: {
-            if (operationType->isFloatingPointTy()) {
+            if (operationType->isFPOrFPVectorTy()) {
                 return mBuilder->CreateFCmp(llvm::FCmpInst::FCMP_OGT, left, right, "gttmp");
             }
             else {
@@ -411,7 +820,7 @@ llvm::Value* CodeGenerator::_generateBinaryOperation(std::unique_ptr<BinaryOpera
             }
         } break;
         case Token::GREATER_EQUALS: {
-            if (operationType->isFloatingPointTy()) {
+            if (operationType->isFPOrFPVectorTy()) {
                 return mBuilder->CreateFCmp(llvm::FCmpInst::FCMP_OGE, left, right, "geqtmp");
             }
             else {
@@ -420,7 +829,7 @@ llvm::Value* CodeGenerator::_generateBinaryOperation(std::unique_ptr<BinaryOpera
             }
         } break;
         case Token::LESS: {
-            if (operationType->isFloatingPointTy()) {
+            if (operationType->isFPOrFPVectorTy()) {
                 return mBuilder->CreateFCmp(llvm::FCmpInst::FCMP_OLT, left, right, "lesstmp");
             }
             else {
@@ -429,7 +838,7 @@ llvm::Value* CodeGenerator::_generateBinaryOperation(std::unique_ptr<BinaryOpera
             }
         } break;
         case Token::LESS_EQUALS: {
-            if (operationType->isFloatingPointTy()) {
+            if (operationType->isFPOrFPVectorTy()) {
                 return mBuilder->CreateFCmp(llvm::FCmpInst::FCMP_OLE, left, right, "leqtmp");
             }
             else {
@@ -450,20 +859,53 @@ llvm::Value* CodeGenerator::_generateBinaryOperation(std::unique_ptr<BinaryOpera
     return nullptr;
 }
 
-llvm::Value* CodeGenerator::_generateVariableDefinition(std::unique_ptr<VariableDefinitionNode>& varDef) {
+llvm::Value* CodeGenerator::_generateVariableDefinition(VariableDefinitionNode* varDef) {
     llvm::Function* parentFunc = mBuilder->GetInsertBlock()->getParent();
-    const std::string& varName = varDef->mName.mIdentifier;
+    const IdentifierNode& varName = varDef->mName;
+    const std::vector<size_t> arraySizes(varDef->mArraySizes.begin(), varDef->mArraySizes.end());
     llvm::Type* varType = _getRawLLVMType(varDef->mType);
     if (!varDef->mArraySizes.empty()) {
         for (size_t arrSize : varDef->mArraySizes) {
             varType = llvm::ArrayType::get(varType, arrSize);
         }
     }
-    llvm::AllocaInst* alloca = mBuilder->CreateAlloca(varType, nullptr, varName);
-    _addSymbolData(varName, alloca, varDef->mType, false, varDef->mArraySizes);
+    if (varDef->mArraySizes.empty()) {
+        _addRegisterSymbolData(varName, varType, varDef->mType, false);
+        const size_t registerId = mRegisters.size() - 1;
+        llvm::Value* value = llvm::UndefValue::get(varType);
+        if (varDef->mInitialValue.has_value()) {
+            value = generateExpressionCode(varDef->mInitialValue.value());
+        }
+        // uninitialized variables still need a definition here so reads don't look past it into earlier blocks
+        _writeRegister(registerId, mBuilder->GetInsertBlock(), value);
+        return nullptr;
+    }
+    // arrays initialized with only number literals get their data from a constant global instead of per element stores
+    llvm::Constant* constantValue = nullptr;
     if (varDef->mInitialValue.has_value()) {
-        ExpressionNodeOwner& expr = varDef->mInitialValue.value();
-        if (auto arrayValue = std::get_if<std::unique_ptr<ArrayValueNode>>(&expr)) {
+        if (auto arrayValue = std::get_if<ArrayValueNode*>(&varDef->mInitialValue.value())) {
+            constantValue = _getConstantArrayValue(**arrayValue, varType);
+        }
+    }
+    if (constantValue) {
+        llvm::GlobalVariable* constantData = new llvm::GlobalVariable(*mModule, varType, true, llvm::GlobalValue::PrivateLinkage, constantValue, llvm::Twine(varName.mIdentifier) + ".init");
+        constantData->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+        // if nothing can modify the array, there's no need for a copy at all
+        if (!_isArrayWritten(mCurrentFunction->mExpression, varName.mSymbol)) {
+            _addSymbolData(varName, constantData, varType, varDef->mType, false, arraySizes);
+            return nullptr;
+        }
+        llvm::AllocaInst* alloca = _createEntryBlockAlloca(varType, varName.mIdentifier);
+        _addSymbolData(varName, alloca, varType, varDef->mType, false, arraySizes);
+        mBuilder->CreateMemCpy(alloca, alloca->getAlign(), constantData, llvm::MaybeAlign(), llvm::ConstantExpr::getSizeOf(varType));
+        return nullptr;
+    }
+    // allocas all go in the entry block so that a definition in a loop doesn't grow the stack every iteration
+    llvm::AllocaInst* alloca = _createEntryBlockAlloca(varType, varName.mIdentifier);
+    _addSymbolData(varName, alloca, varType, varDef->mType, false, arraySizes);
+    if (varDef->mInitialValue.has_value()) {
+        ExpressionNodeRef& expr = varDef->mInitialValue.value();
+        if (auto arrayValue = std::get_if<ArrayValueNode*>(&expr)) {
             // I think the alloca needs to be created in here so it can handle alloca size as well
             _generateArrayValue(*arrayValue, alloca);
         }
@@ -475,19 +917,60 @@ llvm::Value* CodeGenerator::_generateVariableDefinition(std::unique_ptr<Variable
     return nullptr;
 }
 
-llvm::Value* CodeGenerator::_generateAssignment(std::unique_ptr<AssignmentNode>& assignment) {
+llvm::Value* CodeGenerator::_generateAssignment(AssignmentNode* assignment) {
     VariableAccessNode& varAccess = assignment->mVariable.mVariable;
+    std::optional<VariableInfo*> registerData = _getSymbolData(varAccess.mName.mSymbol);
+    if (registerData.has_value() && registerData.value()->mInductionValue) {
+        mErrorHandler.logError("Cannot assign to the loop variable of a for loop");
+        return nullptr;
+    }
+    // the body of a parallel loop only has a copy, writes could never make it back out (and would race if they did)
+    if (registerData.has_value() && registerData.value()->mIsCaptured && registerData.value()->mRegisterType
+        && (!varAccess.mArrayIndices.has_value() || registerData.value()->mRegisterType->isVectorTy())) {
+        mErrorHandler.logError("Cannot assign to a variable from outside a parallel for loop, only to array elements");
+        return nullptr;
+    }
+    if (registerData.has_value() && registerData.value()->mRegisterType && !varAccess.mArrayIndices.has_value()) {
+        const size_t registerId = registerData.value()->mRegisterId;
+        llvm::Value* value = generateExpressionCode(assignment->mValue);
+        _writeRegister(registerId, mBuilder->GetInsertBlock(), value);
+        return nullptr;
+    }
+    if (registerData.has_value() && registerData.value()->mRegisterType && registerData.value()->mRegisterType->isVectorTy()) {
+        // assigning to a lane replaces the whole vector with one that has the lane swapped out
+        const size_t registerId = registerData.value()->mRegisterId;
+        llvm::Type* elementType = registerData.value()->mRegisterType->getScalarType();
+        llvm::Value* lane = _generateLaneIndex(varAccess);
+        llvm::Value* value = generateExpressionCode(assignment->mValue);
+        if (!lane || !value || value->getType() != elementType) {
+            mErrorHandler.logError("Vector lane assignment needs a value of the vector's element type");
+            return nullptr;
+        }
+        llvm::Value* vector = _readRegister(registerId, mBuilder->GetInsertBlock());
+        _writeRegister(registerId, mBuilder->GetInsertBlock(), mBuilder->CreateInsertElement(vector, value, lane));
+        return nullptr;
+    }
+    llvm::Type* elementType = registerData.has_value() ? _getRawLLVMType(registerData.value()->mRawType) : nullptr;
     llvm::Value* memLocation = _getMemLocationFromVariableAccess(varAccess);
     if (!memLocation) {
         mErrorHandler.logError("No memory location found for assignment");
         return nullptr;
     }
     llvm::Value* value = generateExpressionCode(assignment->mValue);
+    if (value && value->getType()->isVectorTy() && elementType && !elementType->isVectorTy()) {
+        // a vector assigned to an element of a scalar array fills that element and the ones after it
+        if (value->getType()->getScalarType() != elementType) {
+            mErrorHandler.logError("Vector stored to an array with a different element type");
+            return nullptr;
+        }
+        mBuilder->CreateAlignedStore(value, memLocation, llvm::Align(elementType->getPrimitiveSizeInBits() / 8));
+        return nullptr;
+    }
     mBuilder->CreateStore(value, memLocation);
     return nullptr;
 }
 
-llvm::Value* CodeGenerator::_generateLoop(std::unique_ptr<LoopNode>& loop) {
+llvm::Value* CodeGenerator::_generateLoop(LoopNode* loop) {
     llvm::Function* parentFunc = mBuilder->GetInsertBlock()->getParent();
     llvm::BasicBlock* loopBlock = llvm::BasicBlock::Create(*mContext, "loop", parentFunc);
     llvm::BasicBlock* afterBlock = llvm::BasicBlock::Create(*mContext, "after");
@@ -495,89 +978,648 @@ llvm::Value* CodeGenerator::_generateLoop(std::unique_ptr<LoopNode>& loop) {
     mBuilder->SetInsertPoint(loopBlock);
 
     mLoopStack.emplace_back(loopBlock, afterBlock);
-    for (ExpressionNodeOwner& expression : loop->mExpressionList) {
+    for (ExpressionNodeRef& expression : loop->mExpressionList) {
         generateExpressionCode(expression);
     }
-    mBuilder->CreateBr(loopBlock);
+    if (!mBuilder->GetInsertBlock()->getTerminator()) {
+        mBuilder->CreateBr(loopBlock);
+    }
+    // the back edge and every break are known now, so both blocks can be sealed
+    _sealBlock(loopBlock);
     afterBlock->insertInto(parentFunc);
     mBuilder->SetInsertPoint(afterBlock);
+    _sealBlock(afterBlock);
     mLoopStack.pop_back();
     return nullptr;
 }
 
-llvm::Value* CodeGenerator::_generateBreak(std::unique_ptr<BreakNode>& br) {
+bool CodeGenerator::_generateForRange(ForNode& forLoop, llvm::Value*& start, llvm::Value*& end) {
+    llvm::Type* boundType = _getRawLLVMType(Token::TYPE_I32);
+    llvm::Type* inductionType = llvm::Type::getInt64Ty(*mContext);
+    start = generateExpressionCode(forLoop.mStart);
+    end = generateExpressionCode(forLoop.mEnd);
+    if (!start || !end || start->getType() != boundType || end->getType() != boundType) {
+        mErrorHandler.logError("For loop range bounds must be i32 values");
+        return false;
+    }
+    start = mBuilder->CreateSExt(start, inductionType, "for.start");
+    end = mBuilder->CreateSExt(end, inductionType, "for.end");
+    return true;
+}
+
+llvm::Value* CodeGenerator::_generateFor(ForNode* forLoop) {
+    llvm::Value* start = nullptr;
+    llvm::Value* end = nullptr;
+    if (!_generateForRange(*forLoop, start, end)) {
+        return nullptr;
+    }
+    if (forLoop->mIsParallel) {
+        return _generateParallelFor(forLoop, start, end);
+    }
+    _generateCountedLoop(start, end, forLoop->mVariable.mIdentifier, [&](llvm::PHINode* induction, llvm::BasicBlock* afterBlock) {
+        return _generateForBody(*forLoop, induction, afterBlock);
+    });
+    return nullptr;
+}
+
+llvm::Value* CodeGenerator::_generateReduce(ReduceNode* reduce) {
+    llvm::Value* start = nullptr;
+    llvm::Value* end = nullptr;
+    if (!_generateForRange(reduce->mLoop, start, end)) {
+        return nullptr;
+    }
+    if (reduce->mLoop.mIsParallel) {
+        return _generateParallelReduce(reduce, start, end);
+    }
+    return _generateCountedLoop(start, end, reduce->mLoop.mVariable.mIdentifier, [&](llvm::PHINode* induction, llvm::BasicBlock*) {
+        // no break target, every iteration of a reduce has to run
+        return _generateForBody(reduce->mLoop, induction, nullptr);
+    }, reduce);
+}
+
+llvm::Value* CodeGenerator::_generateForBody(ForNode& forLoop, llvm::PHINode* induction, llvm::BasicBlock* afterBlock) {
+    _pushNewSymbolScope();
+    VariableInfo inductionInfo{ nullptr, nullptr, Token::TYPE_I32, false, {} };
+    inductionInfo.mInductionValue = induction;
+    _addSymbolData(forLoop.mVariable, std::move(inductionInfo));
+    mLoopStack.emplace_back(induction->getParent(), afterBlock);
+    llvm::Value* value = nullptr;
+    for (ExpressionNodeRef& expression : forLoop.mExpressionList) {
+        value = generateExpressionCode(expression);
+    }
+    mLoopStack.pop_back();
+    _popSymbolScope();
+    return value;
+}
+
+llvm::Value* CodeGenerator::_generateCountedLoop(llvm::Value* start, llvm::Value* end, const llvm::Twine& name, const LoopBodyGenerator& generateBody, const ReduceNode* reduction) {
+    llvm::Function* parentFunc = mBuilder->GetInsertBlock()->getParent();
+    llvm::Type* inductionType = start->getType();
+    // the loop is emitted already rotated, a guard skips empty ranges and the exit test sits at the bottom of the body
+    //  - with the nsw increment that gives scalar evolution an exact trip count of end - start
+    llvm::BasicBlock* guardBlock = mBuilder->GetInsertBlock();
+    llvm::BasicBlock* preheaderBlock = llvm::BasicBlock::Create(*mContext, "for.preheader", parentFunc);
+    llvm::BasicBlock* bodyBlock = llvm::BasicBlock::Create(*mContext, "for.body");
+    llvm::BasicBlock* afterBlock = llvm::BasicBlock::Create(*mContext, "for.after");
+    mBuilder->CreateCondBr(mBuilder->CreateICmpSLT(start, end, "for.guard"), preheaderBlock, afterBlock);
+    _sealBlock(preheaderBlock);
+    mBuilder->SetInsertPoint(preheaderBlock);
+    mBuilder->CreateBr(bodyBlock);
+
+    bodyBlock->insertInto(parentFunc);
+    mBuilder->SetInsertPoint(bodyBlock);
+    llvm::PHINode* induction = mBuilder->CreatePHI(inductionType, 2, name);
+    induction->addIncoming(start, preheaderBlock);
+    llvm::Value* value = generateBody(induction, afterBlock);
+    llvm::BasicBlock* latchBlock = nullptr;
+    llvm::Value* identity = nullptr;
+    llvm::Value* accumulated = nullptr;
+    if (!mBuilder->GetInsertBlock()->getTerminator()) {
+        latchBlock = mBuilder->GetInsertBlock();
+        if (reduction && (identity = _getReductionIdentity(reduction->mKind, value))) {
+            // the accumulator can only be created once the body has given it a type
+            llvm::IRBuilder<> headerBuilder(bodyBlock, bodyBlock->getFirstInsertionPt());
+            llvm::PHINode* accumulator = headerBuilder.CreatePHI(value->getType(), 2, "reduce.accumulator");
+            accumulator->addIncoming(identity, preheaderBlock);
+            accumulated = _combineReduction(*reduction, accumulator, value);
+            accumulator->addIncoming(accumulated, latchBlock);
+        }
+        llvm::Value* next = mBuilder->CreateNSWAdd(induction, llvm::ConstantInt::get(inductionType, 1), "for.next");
+        mBuilder->CreateCondBr(mBuilder->CreateICmpSLT(next, end, "for.cond"), bodyBlock, afterBlock);
+        induction->addIncoming(next, latchBlock);
+    }
+    _sealBlock(bodyBlock);
+    afterBlock->insertInto(parentFunc);
+    mBuilder->SetInsertPoint(afterBlock);
+    _sealBlock(afterBlock);
+    if (!accumulated) {
+        return nullptr;
+    }
+    llvm::PHINode* result = mBuilder->CreatePHI(accumulated->getType(), 2, "reduce.result");
+    result->addIncoming(identity, guardBlock);
+    result->addIncoming(accumulated, latchBlock);
+    return result;
+}
+
+llvm::Value* CodeGenerator::_getReductionIdentity(ReductionKind kind, llvm::Value* value) {
+    llvm::Type* type = value ? value->getType() : nullptr;
+    if (!type || !(type->isFloatingPointTy() || (type->isIntegerTy() && !type->isIntegerTy(1)))) {
+        mErrorHandler.logError("The last expression of a reduce loop must be an i32 or f32 value");
+        return nullptr;
+    }
+    // a plain zero rather than -0.0 for sums, so an empty sum prints the way a hand written one would
+    switch (kind) {
+        case ReductionKind::ADD: return llvm::Constant::getNullValue(type);
+        case ReductionKind::MUL: return type->isFloatingPointTy() ? llvm::ConstantFP::get(type, 1.0) : llvm::ConstantInt::get(type, 1);
+        case ReductionKind::MIN: {
+            return type->isFloatingPointTy() ? llvm::ConstantFP::getInfinity(type, false)
+                : llvm::ConstantInt::get(type, llvm::APInt::getSignedMaxValue(type->getIntegerBitWidth()));
+        }
+        case ReductionKind::MAX: {
+            return type->isFloatingPointTy() ? llvm::ConstantFP::getInfinity(type, true)
+                : llvm::ConstantInt::get(type, llvm::APInt::getSignedMinValue(type->getIntegerBitWidth()));
+        }
+    }
+    return nullptr;
+}
+
+llvm::Value* CodeGenerator::_combineReduction(const ReduceNode& reduction, llvm::Value* accumulated, llvm::Value* value) {
+    // integer reductions can always be reordered, for floats the flag is what lets the vectorizer keep one
+    //  partial result per lane and combine them as a tree at the end
+    llvm::IRBuilderBase::FastMathFlagGuard flagGuard(*mBuilder);
+    if (reduction.mReassociate) {
+        llvm::FastMathFlags flags = mBuilder->getFastMathFlags();
+        flags.setAllowReassoc();
+        mBuilder->setFastMathFlags(flags);
+    }
+    const bool isFloat = value->getType()->isFloatingPointTy();
+    switch (reduction.mKind) {
+        case ReductionKind::ADD: {
+            return isFloat ? mBuilder->CreateFAdd(accumulated, value, "reduce.add") : mBuilder->CreateAdd(accumulated, value, "reduce.add");
+        }
+        case ReductionKind::MUL: {
+            return isFloat ? mBuilder->CreateFMul(accumulated, value, "reduce.mul") : mBuilder->CreateMul(accumulated, value, "reduce.mul");
+        }
+        case ReductionKind::MIN: {
+            return isFloat ? mBuilder->CreateMinNum(accumulated, value, "reduce.min")
+                : mBuilder->CreateBinaryIntrinsic(llvm::Intrinsic::smin, accumulated, value, nullptr, "reduce.min");
+        }
+        case ReductionKind::MAX: {
+            return isFloat ? mBuilder->CreateMaxNum(accumulated, value, "reduce.max")
+                : mBuilder->CreateBinaryIntrinsic(llvm::Intrinsic::smax, accumulated, value, nullptr, "reduce.max");
+        }
+    }
+    return nullptr;
+}
+
+llvm::Value* CodeGenerator::_generateParallelFor(ForNode* forLoop, llvm::Value* start, llvm::Value* end) {
+    ParallelBody body = _outlineParallelBody(*forLoop, {}, [&](llvm::ArrayRef<llvm::Value*>, llvm::Value* begin, llvm::Value* rangeEnd) {
+        _generateCountedLoop(begin, rangeEnd, forLoop->mVariable.mIdentifier, [&](llvm::PHINode* induction, llvm::BasicBlock*) {
+            return _generateForBody(*forLoop, induction, nullptr);
+        });
+    });
+    const size_t grainSize = forLoop->mGrainSize ? forLoop->mGrainSize : mOptions.mParallelGrainSize;
+    _callParallelBody(body, {}, start, end, grainSize, mOptions.mDeterministicParallel);
+    return nullptr;
+}
+
+llvm::Value* CodeGenerator::_generateParallelReduce(ReduceNode* reduce, llvm::Value* start, llvm::Value* end) {
+    ForNode& forLoop = reduce->mLoop;
+    llvm::Type* inductionType = start->getType();
+    auto indexConstant = [inductionType](uint64_t value) {
+        return llvm::ConstantInt::get(inductionType, value);
+    };
+    // the range is cut into at most parallelReduceChunks chunks, picked from the range and grain size alone, and the
+    //  partial results are combined in chunk order, so the result doesn't depend on the thread count or on who ran what
+    constexpr uint64_t parallelReduceChunks = 256;
+    const size_t grainSize = std::max<size_t>(forLoop.mGrainSize ? forLoop.mGrainSize : mOptions.mParallelGrainSize, 1);
+    llvm::Value* count = mBuilder->CreateSub(end, start, "reduce.count");
+    llvm::Value* spread = mBuilder->CreateSDiv(mBuilder->CreateAdd(count, indexConstant(parallelReduceChunks - 1)), indexConstant(parallelReduceChunks));
+    llvm::Value* chunkSize = mBuilder->CreateSelect(mBuilder->CreateICmpSGT(spread, indexConstant(grainSize)), spread, indexConstant(grainSize), "reduce.chunksize");
+    llvm::Value* chunkCount = mBuilder->CreateSDiv(mBuilder->CreateAdd(count, mBuilder->CreateSub(chunkSize, indexConstant(1))), chunkSize, "reduce.chunks");
+
+    // every chunk writes its partial result to its own slot, the type of those is only known once the body is generated
+    llvm::Type* partialType = nullptr;
+    llvm::Type* pointerType = llvm::PointerType::getUnqual(*mContext);
+    llvm::Type* sharedTypes[] = { pointerType, inductionType, inductionType, inductionType };
+    ParallelBody body = _outlineParallelBody(forLoop, sharedTypes, [&](llvm::ArrayRef<llvm::Value*> shared, llvm::Value* firstChunk, llvm::Value* lastChunk) {
+        llvm::Value* partials = shared[0];
+        llvm::Value* rangeStart = shared[1];
+        llvm::Value* rangeEnd = shared[2];
+        llvm::Value* rangeChunkSize = shared[3];
+        _generateCountedLoop(firstChunk, lastChunk, "chunk", [&](llvm::PHINode* chunk, llvm::BasicBlock*) -> llvm::Value* {
+            llvm::Value* chunkBegin = mBuilder->CreateNSWAdd(rangeStart, mBuilder->CreateNSWMul(chunk, rangeChunkSize), "chunk.begin");
+            llvm::Value* chunkEnd = mBuilder->CreateNSWAdd(chunkBegin, rangeChunkSize);
+            chunkEnd = mBuilder->CreateSelect(mBuilder->CreateICmpSLT(chunkEnd, rangeEnd), chunkEnd, rangeEnd, "chunk.end");
+            llvm::Value* partial = _generateCountedLoop(chunkBegin, chunkEnd, forLoop.mVariable.mIdentifier, [&](llvm::PHINode* induction, llvm::BasicBlock*) {
+                return _generateForBody(forLoop, induction, nullptr);
+            }, reduce);
+            if (partial) {
+                partialType = partial->getType();
+                mBuilder->CreateStore(partial, mBuilder->CreateGEP(partialType, partials, chunk));
+            }
+            return nullptr;
+        });
+    });
+    if (!partialType) {
+        return nullptr;
+    }
+    llvm::AllocaInst* partials = _createEntryBlockAlloca(llvm::ArrayType::get(partialType, parallelReduceChunks), "reduce.partials");
+    llvm::Value* sharedValues[] = { partials, start, end, chunkSize };
+    // every call gets whole chunks, so a grain of one chunk leaves the runtime free to balance them
+    _callParallelBody(body, sharedValues, indexConstant(0), chunkCount, 1, mOptions.mDeterministicParallel);
+    return _generateCountedLoop(indexConstant(0), chunkCount, "chunk", [&](llvm::PHINode* chunk, llvm::BasicBlock*) {
+        return mBuilder->CreateLoad(partialType, mBuilder->CreateGEP(partialType, partials, chunk), "partial");
+    }, reduce);
+}
+
+CodeGenerator::ParallelBody CodeGenerator::_outlineParallelBody(ForNode& forLoop, llvm::ArrayRef<llvm::Type*> sharedTypes, const ParallelRangeGenerator& generateRange) {
+    llvm::Function* parentFunc = mBuilder->GetInsertBlock()->getParent();
+    llvm::Type* inductionType = llvm::Type::getInt64Ty(*mContext);
+
+    // everything the body reads from outside the loop is copied into a context struct that the outlined body gets passed
+    //  - registers and loop variables are copied by value, arrays by address, constant arrays are globals and need nothing
+    //  - the values the caller shares with the body come first
+    std::vector<bool> usedSymbols(mVisibleBindings.size(), false);
+    _collectSymbols(forLoop.mExpressionList, usedSymbols);
+    struct Capture {
+        SymbolId mSymbol;
+        VariableInfo mInfo;
+        llvm::Value* mValue;
+    };
+    std::vector<Capture> captures;
+    ParallelBody body;
+    std::vector<llvm::Type*> contextTypes(sharedTypes.begin(), sharedTypes.end());
+    for (SymbolId symbol = 0; symbol < usedSymbols.size(); symbol++) {
+        if (!usedSymbols[symbol] || symbol == forLoop.mVariable.mSymbol || mVisibleBindings[symbol] == noBinding) {
+            continue;
+        }
+        const VariableInfo& info = mSymbolBindings[mVisibleBindings[symbol]].mInfo;
+        llvm::Value* value = nullptr;
+        if (info.mInductionValue) {
+            value = info.mInductionValue;
+        }
+        else if (info.mRegisterType) {
+            value = _readRegister(info.mRegisterId, mBuilder->GetInsertBlock());
+        }
+        else if (info.mMemory && !llvm::isa<llvm::Constant>(info.mMemory)) {
+            value = info.mMemory;
+        }
+        captures.push_back({ symbol, info, value });
+        if (value) {
+            contextTypes.push_back(value->getType());
+            body.mCapturedValues.push_back(value);
+        }
+    }
+    body.mContextType = llvm::StructType::get(*mContext, contextTypes);
+
+    llvm::Type* bodyArguments[] = { llvm::PointerType::getUnqual(*mContext), inductionType, inductionType };
+    llvm::FunctionType* bodyType = llvm::FunctionType::get(llvm::Type::getVoidTy(*mContext), bodyArguments, false);
+    body.mFunction = llvm::Function::Create(bodyType, llvm::Function::InternalLinkage, parentFunc->getName() + ".parallel", *mModule);
+    _addFunctionAttributes(body.mFunction, *mCurrentFunction);
+    llvm::Value* contextArgument = body.mFunction->getArg(0);
+    llvm::Value* beginArgument = body.mFunction->getArg(1);
+    llvm::Value* endArgument = body.mFunction->getArg(2);
+    contextArgument->setName("context");
+    beginArgument->setName("begin");
+    endArgument->setName("end");
+
+    // the body is generated in the middle of the parent function, so put aside what belongs to it
+    //  - the SSA tables are per block, and the body's blocks are all new, so those can be shared
+    llvm::BasicBlock* parentBlock = mBuilder->GetInsertBlock();
+    std::vector<std::pair<llvm::BasicBlock*, llvm::BasicBlock*>> parentLoops;
+    parentLoops.swap(mLoopStack);
+    llvm::BasicBlock* entryBlock = llvm::BasicBlock::Create(*mContext, "entry", body.mFunction);
+    mBuilder->SetInsertPoint(entryBlock);
+    _sealBlock(entryBlock);
+    unsigned int field = 0;
+    std::vector<llvm::Value*> sharedValues;
+    for (llvm::Type* sharedType : sharedTypes) {
+        sharedValues.push_back(mBuilder->CreateLoad(sharedType, mBuilder->CreateStructGEP(body.mContextType, contextArgument, field++)));
+    }
+    _pushNewSymbolScope();
+    for (Capture& capture : captures) {
+        VariableInfo info = capture.mInfo;
+        info.mIsCaptured = true;
+        if (capture.mValue) {
+            const std::string_view name = mIdentifiers.getName(capture.mSymbol);
+            llvm::Value* value = mBuilder->CreateLoad(capture.mValue->getType(), mBuilder->CreateStructGEP(body.mContextType, contextArgument, field++), name);
+            if (info.mInductionValue) {
+                info.mInductionValue = value;
+            }
+            else if (info.mRegisterType) {
+                mRegisters.push_back({ info.mRegisterType, name });
+                info.mRegisterId = mRegisters.size() - 1;
+                _writeRegister(info.mRegisterId, entryBlock, value);
+            }
+            else {
+                info.mMemory = value;
+            }
+        }
+        _addSymbolData(IdentifierNode{ mIdentifiers.getName(capture.mSymbol), capture.mSymbol }, std::move(info));
+    }
+    generateRange(sharedValues, beginArgument, endArgument);
+    mBuilder->CreateRetVoid();
+    _popSymbolScope();
+    mLoopStack.swap(parentLoops);
+    mBuilder->SetInsertPoint(parentBlock);
+    return body;
+}
+
+void CodeGenerator::_callParallelBody(const ParallelBody& body, llvm::ArrayRef<llvm::Value*> sharedValues, llvm::Value* begin, llvm::Value* end, size_t grainSize, bool deterministic) {
+    llvm::AllocaInst* context = _createEntryBlockAlloca(body.mContextType, "parallel.context");
+    unsigned int field = 0;
+    for (llvm::Value* value : sharedValues) {
+        mBuilder->CreateStore(value, mBuilder->CreateStructGEP(body.mContextType, context, field++));
+    }
+    for (llvm::Value* value : body.mCapturedValues) {
+        mBuilder->CreateStore(value, mBuilder->CreateStructGEP(body.mContextType, context, field++));
+    }
+
+    // see runtime/parallel.h
+    llvm::Type* pointerType = llvm::PointerType::getUnqual(*mContext);
+    llvm::Type* inductionType = begin->getType();
+    llvm::Type* int32Type = llvm::Type::getInt32Ty(*mContext);
+    llvm::Type* runtimeArguments[] = { pointerType, pointerType, inductionType, inductionType, inductionType, int32Type };
+    llvm::FunctionCallee parallelFor = mModule->getOrInsertFunction("velvet_parallel_for",
+        llvm::FunctionType::get(llvm::Type::getVoidTy(*mContext), runtimeArguments, false));
+    llvm::Value* arguments[] = {
+        body.mFunction, context, begin, end,
+        llvm::ConstantInt::get(inductionType, grainSize),
+        llvm::ConstantInt::get(int32Type, deterministic ? 1 : 0)
+    };
+    mBuilder->CreateCall(parallelFor, arguments);
+}
+
+llvm::Value* CodeGenerator::_generateBreak(BreakNode* br) {
     if (mLoopStack.empty()) {
         mErrorHandler.logError("Cannot break if there is no loop");
         return nullptr;
     }
+    if (!mLoopStack.back().second) {
+        mErrorHandler.logError("Cannot break out of a parallel or reduce loop, every iteration has to run");
+        return nullptr;
+    }
     mBuilder->CreateBr(mLoopStack.back().second);
     return nullptr;
 }
 
 void CodeGenerator::_pushNewSymbolScope() {
-    mSymbolStack.emplace_back();
+    mScopeStarts.push_back(mSymbolBindings.size());
 }
 
 void CodeGenerator::_popSymbolScope() {
-    mSymbolStack.pop_back();
+    // unwind in reverse so a name defined twice in the scope ends up pointing at what it shadowed before the scope
+    const size_t scopeStart = mScopeStarts.back();
+    for (size_t index = mSymbolBindings.size(); index > scopeStart; index--) {
+        const SymbolBinding& binding = mSymbolBindings[index - 1];
+        mVisibleBindings[binding.mSymbol] = binding.mShadowed;
+    }
+    mSymbolBindings.resize(scopeStart);
+    mScopeStarts.pop_back();
 }
 
-void CodeGenerator::_addSymbolData(const std::string& varName, llvm::AllocaInst* alloca, Token rawType, bool isDecayedArray, std::vector<size_t> arraySize) {
-    if (mSymbolStack.empty()) {
+void CodeGenerator::_addSymbolData(const IdentifierNode& name, VariableInfo info) {
+    if (mScopeStarts.empty()) {
         mErrorHandler.logError("No valid scope to add symbol data to");
         return;
     }
-    mSymbolStack.back()[varName] = { alloca, rawType, isDecayedArray, arraySize };
+    if (name.mSymbol >= mVisibleBindings.size()) {
+        mErrorHandler.logError("Unknown symbol for identifier " + std::string(name.mIdentifier));
+        return;
+    }
+    mSymbolBindings.push_back({ name.mSymbol, mVisibleBindings[name.mSymbol], std::move(info) });
+    mVisibleBindings[name.mSymbol] = mSymbolBindings.size() - 1;
 }
 
-std::optional<VariableInfo*> CodeGenerator::_getSymbolData(const std::string& symbol) {
-    for (int index = mSymbolStack.size() - 1; index >= 0; index--) {
-        if (mSymbolStack[index].find(symbol) != mSymbolStack[index].end()) {
-            return &mSymbolStack[index].at(symbol);
-        }
+void CodeGenerator::_addSymbolData(const IdentifierNode& name, llvm::Value* memory, llvm::Type* memoryType, Token rawType, bool isDecayedArray, std::vector<size_t> arraySize) {
+    _addSymbolData(name, VariableInfo{ memory, memoryType, rawType, isDecayedArray, std::move(arraySize) });
+}
+
+void CodeGenerator::_addRegisterSymbolData(const IdentifierNode& name, llvm::Type* type, Token rawType, bool isDecayedArray) {
+    mRegisters.push_back({ type, name.mIdentifier });
+    _addSymbolData(name, VariableInfo{ nullptr, nullptr, rawType, isDecayedArray, {}, type, mRegisters.size() - 1 });
+}
+
+std::optional<VariableInfo*> CodeGenerator::_getSymbolData(SymbolId symbol) {
+    if (symbol >= mVisibleBindings.size() || mVisibleBindings[symbol] == noBinding) {
+        return std::nullopt;
     }
-    return std::nullopt;
+    return &mSymbolBindings[mVisibleBindings[symbol]].mInfo;
+}
+
+llvm::Function* CodeGenerator::_getFunction(SymbolId symbol) const {
+    return symbol < mFunctions.size() ? mFunctions[symbol] : nullptr;
 }
 
 llvm::Value* CodeGenerator::_getMemLocationFromVariableAccess(VariableAccessNode& varAccess) {
-    const std::string& varName = varAccess.mName.mIdentifier;
     llvm::Value* memLocation = nullptr;
     // shares a lot of code with VariableAccess, perhaps can refactor somehow
-    std::optional<VariableInfo*> varInfo = _getSymbolData(varName);
+    std::optional<VariableInfo*> varInfo = _getSymbolData(varAccess.mName.mSymbol);
     if (varInfo.has_value()) {
-        llvm::AllocaInst* alloca = varInfo.value()->mAlloca;
+        llvm::Value* memory = varInfo.value()->mMemory;
         llvm::Type* elementType = _getRawLLVMType(varInfo.value()->mRawType);
         if (varAccess.mArrayIndices.has_value()) {
             std::vector<llvm::Value*> indexStack;
-            llvm::Type* addrType = alloca->getAllocatedType();
+            llvm::Type* addrType = varInfo.value()->mMemoryType;
             // If the ptr is decayed, ptr type is opaque and GEP needs to be done one by one
             if (varInfo.value()->mIsDecayedArray) {
                 addrType = elementType;
-                llvm::Value* memAddr = mBuilder->CreateLoad(llvm::PointerType::getUnqual(*mContext), alloca, "ptrload");  // (ORIGINAL CODE)
+                // decayed arrays are always arguments, which keep their pointer in a register
+                llvm::Value* memAddr = _readRegister(varInfo.value()->mRegisterId, mBuilder->GetInsertBlock());
                 size_t count = 0;
                 // TODO: Working on this - need to fix the GEP instructions
                 //  - may have to modify symbol table data to store array size data so it can be accessed in the GEP instructions
                 //  - this seems to somehow be working right now... maybe leave it for now, revisit when it's broken again...
-                for (ExpressionNodeOwner& expr : varAccess.mArrayIndices.value()) {
-                    llvm::Value* indexExpr = generateExpressionCode(expr);
+                for (ExpressionNodeRef& expr : varAccess.mArrayIndices.value()) {
+                    llvm::Value* indexExpr = _generateArrayIndex(expr);
+                    if (!indexExpr) {
+                        return nullptr;
+                    }
                     llvm::Type* type = (++count >= varAccess.mArrayIndices.value().size()) ? addrType : llvm::PointerType::getUnqual(*mContext);
                     memAddr = mBuilder->CreateGEP(type, memAddr, { indexExpr }, "arrayidx");
                 }
                 return memAddr;
             }
             // Otherwise if normal array type, can use all indices directly in GEP instruction
-            else {
+            else if (memory) {
                 indexStack.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*mContext), 0));
-                for (ExpressionNodeOwner& expr : varAccess.mArrayIndices.value()) {
-                    llvm::Value* indexExpr = generateExpressionCode(expr);
+                for (ExpressionNodeRef& expr : varAccess.mArrayIndices.value()) {
+                    llvm::Value* indexExpr = _generateArrayIndex(expr);
+                    if (!indexExpr) {
+                        return nullptr;
+                    }
                     indexStack.push_back(indexExpr);
                 }
-                return mBuilder->CreateGEP(addrType, alloca, indexStack);
+                return mBuilder->CreateGEP(addrType, memory, indexStack);
+            }
+            else {
+                mErrorHandler.logError("Cannot index into a variable that is not an array");
+                return nullptr;
             }
         }
         else {
-            return alloca;
+            // register variables have no memory location
+            return memory;
         }
     }
     return nullptr;
+}
+
+llvm::Value* CodeGenerator::_generateArrayIndex(ExpressionNodeRef& expressionNode) {
+    // a for loop variable is used as is, so the address stays a simple function of the i64 induction variable
+    if (auto variable = std::get_if<VariableAccessNode*>(&expressionNode)) {
+        if (*variable && !(*variable)->mArrayIndices.has_value() && !(*variable)->mCallArgs.has_value()) {
+            std::optional<VariableInfo*> varInfo = _getSymbolData((*variable)->mName.mSymbol);
+            if (varInfo.has_value() && varInfo.value()->mInductionValue) {
+                return varInfo.value()->mInductionValue;
+            }
+        }
+    }
+    llvm::Value* index = generateExpressionCode(expressionNode);
+    if (!index || !index->getType()->isIntegerTy()) {
+        mErrorHandler.logError("Array index must be an integer");
+        return nullptr;
+    }
+    // GEP sign extends its indices to pointer width anyway, doing it explicitly keeps every index the same type
+    return mBuilder->CreateSExt(index, llvm::Type::getInt64Ty(*mContext), "idxprom");
+}
+
+llvm::Value* CodeGenerator::_generateLaneIndex(VariableAccessNode& varAccess) {
+    NodeList& indices = varAccess.mArrayIndices.value();
+    if (indices.size() != 1) {
+        mErrorHandler.logError("Vector lanes are accessed with a single index");
+        return nullptr;
+    }
+    llvm::Value* lane = generateExpressionCode(indices[0]);
+    if (!lane || !lane->getType()->isIntegerTy()) {
+        mErrorHandler.logError("Vector lane index must be an integer");
+        return nullptr;
+    }
+    return lane;
+}
+
+llvm::Value* CodeGenerator::_generateLaneReduction(ReductionKind reduction, NodeList& arguments) {
+    llvm::Value* vector = arguments.size() == 1 ? generateExpressionCode(arguments[0]) : nullptr;
+    if (!vector || !vector->getType()->isVectorTy()) {
+        mErrorHandler.logError("Horizontal vector operations take a single vector");
+        return nullptr;
+    }
+    llvm::Type* elementType = vector->getType()->getScalarType();
+    if (!elementType->isFloatingPointTy()) {
+        switch (reduction) {
+            case ReductionKind::ADD: return mBuilder->CreateAddReduce(vector);
+            case ReductionKind::MUL: return mBuilder->CreateMulReduce(vector);
+            case ReductionKind::MIN: return mBuilder->CreateIntMinReduce(vector, true);
+            case ReductionKind::MAX: return mBuilder->CreateIntMaxReduce(vector, true);
+        }
+    }
+    // the float reductions are ordered unless reassociation is allowed, but a horizontal operation is expected to
+    //  combine the lanes pairwise like a shuffle tree would, so they're allowed to here
+    llvm::CallInst* result = nullptr;
+    switch (reduction) {
+        case ReductionKind::ADD: {
+            result = mBuilder->CreateFAddReduce(llvm::ConstantFP::getNegativeZero(elementType), vector);
+        } break;
+        case ReductionKind::MUL: {
+            result = mBuilder->CreateFMulReduce(llvm::ConstantFP::get(elementType, 1.0), vector);
+        } break;
+        case ReductionKind::MIN: {
+            return mBuilder->CreateFPMinReduce(vector);
+        } break;
+        case ReductionKind::MAX: {
+            return mBuilder->CreateFPMaxReduce(vector);
+        } break;
+    }
+    result->setHasAllowReassoc(true);
+    return result;
+}
+
+llvm::AllocaInst* CodeGenerator::_createEntryBlockAlloca(llvm::Type* type, const llvm::Twine& name) {
+    llvm::Function* parentFunc = mBuilder->GetInsertBlock()->getParent();
+    llvm::BasicBlock& entryBlock = parentFunc->getEntryBlock();
+    llvm::IRBuilder<> entryBuilder(&entryBlock, entryBlock.begin());
+    return entryBuilder.CreateAlloca(type, nullptr, name);
+}
+
+void CodeGenerator::_writeRegister(size_t registerId, llvm::BasicBlock* block, llvm::Value* value) {
+    mCurrentDefinitions[block][registerId] = value;
+}
+
+llvm::Value* CodeGenerator::_readRegister(size_t registerId, llvm::BasicBlock* block) {
+    auto blockIt = mCurrentDefinitions.find(block);
+    if (blockIt != mCurrentDefinitions.end()) {
+        auto it = blockIt->second.find(registerId);
+        if (it != blockIt->second.end() && it->second) {
+            return it->second;
+        }
+    }
+    return _readRegisterRecursive(registerId, block);
+}
+
+llvm::Value* CodeGenerator::_readRegisterRecursive(size_t registerId, llvm::BasicBlock* block) {
+    llvm::Value* value = nullptr;
+    if (mSealedBlocks.find(block) == mSealedBlocks.end()) {
+        // not all predecessors are known yet, the operands get filled in once the block is sealed
+        llvm::PHINode* phi = _createRegisterPhi(registerId, block);
+        mIncompletePhis[block].emplace_back(registerId, phi);
+        value = phi;
+    }
+    else if (llvm::BasicBlock* predecessor = block->getSinglePredecessor()) {
+        value = _readRegister(registerId, predecessor);
+    }
+    else if (llvm::pred_empty(block)) {
+        // either the entry block or unreachable, in both cases the variable was never defined
+        value = llvm::UndefValue::get(mRegisters[registerId].mType);
+    }
+    else {
+        llvm::PHINode* phi = _createRegisterPhi(registerId, block);
+        // write the phi before looking at the predecessors to break cycles through loops
+        _writeRegister(registerId, block, phi);
+        value = _addPhiOperands(registerId, phi);
+    }
+    _writeRegister(registerId, block, value);
+    return value;
+}
+
+llvm::PHINode* CodeGenerator::_createRegisterPhi(size_t registerId, llvm::BasicBlock* block) {
+    const RegisterInfo& info = mRegisters[registerId];
+    // phis always have to be grouped at the very start of the block
+    if (block->empty()) {
+        return llvm::PHINode::Create(info.mType, 0, info.mName, block);
+    }
+    return llvm::PHINode::Create(info.mType, 0, info.mName, &block->front());
+}
+
+llvm::Value* CodeGenerator::_addPhiOperands(size_t registerId, llvm::PHINode* phi) {
+    llvm::BasicBlock* block = phi->getParent();
+    for (llvm::BasicBlock* predecessor : llvm::predecessors(block)) {
+        phi->addIncoming(_readRegister(registerId, predecessor), predecessor);
+    }
+    return _tryRemoveTrivialPhi(phi);
+}
+
+llvm::Value* CodeGenerator::_tryRemoveTrivialPhi(llvm::PHINode* phi) {
+    llvm::Value* same = nullptr;
+    for (llvm::Value* operand : phi->incoming_values()) {
+        if (operand == same || operand == phi) {
+            continue;
+        }
+        if (same) {
+            // merges at least two different values, so the phi is needed
+            return phi;
+        }
+        same = operand;
+    }
+    if (!same) {
+        same = llvm::UndefValue::get(phi->getType());
+    }
+    std::vector<llvm::WeakTrackingVH> phiUsers;
+    for (llvm::User* user : phi->users()) {
+        if (user != phi && llvm::isa<llvm::PHINode>(user)) {
+            phiUsers.emplace_back(user);
+        }
+    }
+    // definitions are weak tracking handles, so replacing the phi also updates them
+    phi->replaceAllUsesWith(same);
+    phi->eraseFromParent();
+    // removing this phi might have made the phis using it trivial as well
+    for (llvm::WeakTrackingVH& user : phiUsers) {
+        if (llvm::PHINode* userPhi = llvm::dyn_cast_or_null<llvm::PHINode>(user)) {
+            _tryRemoveTrivialPhi(userPhi);
+        }
+    }
+    return same;
+}
+
+void CodeGenerator::_sealBlock(llvm::BasicBlock* block) {
+    mSealedBlocks.insert(block);
+    auto it = mIncompletePhis.find(block);
+    if (it != mIncompletePhis.end()) {
+        std::vector<std::pair<size_t, llvm::PHINode*>> incompletePhis = std::move(it->second);
+        mIncompletePhis.erase(it);
+        for (auto& [registerId, phi] : incompletePhis) {
+            _addPhiOperands(registerId, phi);
+        }
+    }
 }
\ No newline at end of file
@@ -1,24 +1,42 @@
 #pragma once
 
+#include <functional>
+#include <limits>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <utility>
 
 #include "error/errorHandler.h"
+#include "options/options.h"
 #include "parser/ast.h"
+#include "parser/identifierTable.h"
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Twine.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/ValueHandle.h"
 
 // TODO: Maybe look to move this to a common struct to share with parser?
 struct VariableInfo {
-    llvm::AllocaInst* mAlloca;
+    // an alloca, or a constant global for arrays that are only ever read
+    llvm::Value* mMemory;
+    llvm::Type* mMemoryType;
     Token mRawType;
     bool mIsDecayedArray;
     std::vector<size_t> mArraySize;
+    // variables that never need an address are kept in SSA registers instead of an alloca
+    //  - these have no alloca, their value is looked up per basic block from the register id
+    llvm::Type* mRegisterType = nullptr;
+    size_t mRegisterId = 0;
+    // the i64 induction variable of a for loop, reads see it truncated to i32 but array indices use it directly
+    llvm::Value* mInductionValue = nullptr;
+    // a copy passed into the outlined body of a parallel for loop, only the array elements behind it can be written
+    bool mIsCaptured = false;
 };
 
 class CodeGenerator {
@@ -27,42 +45,128 @@ class CodeGenerator {
     std::unique_ptr<llvm::IRBuilder<>> mBuilder;
 
     ErrorHandler& mErrorHandler;
+    const BuildOptions& mOptions;
+    // shared with the parser that built the AST, symbols in the tree are ids into it
+    //  - only ever read, several generators can work off the same table at once
+    const IdentifierTable& mIdentifiers;
 
     llvm::Type* _getRawLLVMType(Token type) const;
+    void _addFunctionAttributes(llvm::Function* func, const FunctionDefinitionNode& functionDefinition);
+    llvm::FastMathFlags _getFastMathFlags(const FunctionDefinitionNode& functionDefinition) const;
 public:
-    CodeGenerator(ErrorHandler& handler);
+    CodeGenerator(ErrorHandler& handler, const BuildOptions& options, const IdentifierTable& identifiers);
 
     void setupDefaultFunctions();
 
-    llvm::Value* generateExpressionCode(ExpressionNodeOwner& expressionNode);
+    llvm::Value* generateExpressionCode(ExpressionNodeRef& expressionNode);
+    // creates the function's prototype without a body, so it can be called before (or without) being generated
+    llvm::Function* declareFunction(FunctionDefinitionNode& functionDefinition);
+    // fills in the body of a declared function, functions that weren't declared yet are declared first
     llvm::Function* generateFunctionCode(FunctionDefinitionNode& functionDefinition);
 
     std::unique_ptr<llvm::Module>& getModule();
+    std::unique_ptr<llvm::LLVMContext>& getContext();
 private:
-    using SymbolTable = std::unordered_map<std::string, VariableInfo>;
-    std::vector<SymbolTable> mSymbolStack;
-    std::unordered_map<std::string, llvm::Function*> mFunctions;
+    // every variable that is in scope right now, in definition order, so a scope is just a range at the end
+    //  - each binding remembers what it shadowed so popping a scope can restore the outer definitions
+    //  - pointers into this are only good until the next definition, nested expressions can add bindings
+    struct SymbolBinding {
+        SymbolId mSymbol;
+        size_t mShadowed;
+        VariableInfo mInfo;
+    };
+    static constexpr size_t noBinding = std::numeric_limits<size_t>::max();
+    std::vector<SymbolBinding> mSymbolBindings;
+    // innermost binding for each symbol id, looking up a name is a single index
+    std::vector<size_t> mVisibleBindings;
+    // where each open scope starts in mSymbolBindings
+    std::vector<size_t> mScopeStarts;
+    // indexed by symbol id as well, nullptr if the name isn't a function
+    std::vector<llvm::Function*> mFunctions;
+    SymbolId mPrintfSymbol = invalidSymbol;
+    // horizontal operations over the lanes of a vector, the names are only builtins if no function takes them
+    std::vector<std::pair<SymbolId, ReductionKind>> mLaneReductionSymbols;
+    // the loop and after blocks of every loop being generated, parallel loops have no after block since they can't be broken out of
     std::vector<std::pair<llvm::BasicBlock*, llvm::BasicBlock*>> mLoopStack;
+    FunctionDefinitionNode* mCurrentFunction = nullptr;
 
-    llvm::Value* _generateVariableAccess(std::unique_ptr<VariableAccessNode>& varAccess);
-    llvm::Value* _generateNumber(std::unique_ptr<NumberNode>& number);
-    llvm::Value* _generateScope(std::unique_ptr<ScopeNode>& scope);
-    llvm::Value* _generateConditional(std::unique_ptr<ConditionalNode>& conditional);
-    llvm::Value* _generateBinaryOperation(std::unique_ptr<BinaryOperationNode>& binaryOperation);
+    llvm::Value* _generateVariableAccess(VariableAccessNode* varAccess);
+    llvm::Value* _generateNumber(NumberNode* number);
+    llvm::Value* _generateScope(ScopeNode* scope);
+    llvm::Value* _generateConditional(ConditionalNode* conditional);
+    llvm::Value* _generateBinaryOperation(BinaryOperationNode* binaryOperation);
     
-    llvm::Value* _generateVariableDefinition(std::unique_ptr<VariableDefinitionNode>& varDef);    
-    llvm::Value* _generateAssignment(std::unique_ptr<AssignmentNode>& assignment);
-    llvm::Value* _generateLoop(std::unique_ptr<LoopNode>& loop);
-    llvm::Value* _generateBreak(std::unique_ptr<BreakNode>& br);
+    llvm::Value* _generateVariableDefinition(VariableDefinitionNode* varDef);    
+    llvm::Value* _generateAssignment(AssignmentNode* assignment);
+    llvm::Value* _generateLoop(LoopNode* loop);
+    llvm::Value* _generateFor(ForNode* forLoop);
+    llvm::Value* _generateReduce(ReduceNode* reduce);
+    llvm::Value* _generateParallelFor(ForNode* forLoop, llvm::Value* start, llvm::Value* end);
+    llvm::Value* _generateParallelReduce(ReduceNode* reduce, llvm::Value* start, llvm::Value* end);
+    llvm::Value* _generateBreak(BreakNode* br);
 
     // special case codegen functions
-    llvm::Value* _generateArrayValue(std::unique_ptr<ArrayValueNode>& arrayValue, llvm::AllocaInst* alloca);
+    llvm::Value* _generateArrayValue(ArrayValueNode* arrayValue, llvm::AllocaInst* alloca);
+    llvm::Value* _generateVectorValue(VectorValueNode* vectorValue);
+    llvm::Constant* _getConstantArrayValue(ArrayValueNode& arrayValue, llvm::Type* type);
 
 private:
     void _pushNewSymbolScope();
     void _popSymbolScope();
-    void _addSymbolData(const std::string& varName, llvm::AllocaInst* alloca, Token rawType, bool isDecayedArray, std::vector<size_t> arraySize);
-    std::optional<VariableInfo*> _getSymbolData(const std::string& symbol);
+    void _addSymbolData(const IdentifierNode& name, VariableInfo info);
+    void _addSymbolData(const IdentifierNode& name, llvm::Value* memory, llvm::Type* memoryType, Token rawType, bool isDecayedArray, std::vector<size_t> arraySize);
+    void _addRegisterSymbolData(const IdentifierNode& name, llvm::Type* type, Token rawType, bool isDecayedArray);
+    std::optional<VariableInfo*> _getSymbolData(SymbolId symbol);
+    llvm::Function* _getFunction(SymbolId symbol) const;
+
+    llvm::AllocaInst* _createEntryBlockAlloca(llvm::Type* type, const llvm::Twine& name);
 
     llvm::Value* _getMemLocationFromVariableAccess(VariableAccessNode& varAccess);
+    llvm::Value* _generateArrayIndex(ExpressionNodeRef& expressionNode);
+    llvm::Value* _generateLaneIndex(VariableAccessNode& varAccess);
+    llvm::Value* _generateLaneReduction(ReductionKind reduction, NodeList& arguments);
+
+private:
+    // emits the body for one iteration given the loop's induction variable, returns the value a reduction combines
+    //  - after block is where a break goes, nullptr if the loop can't be broken out of
+    using LoopBodyGenerator = std::function<llvm::Value*(llvm::PHINode* induction, llvm::BasicBlock* afterBlock)>;
+    // emits the body of a parallel loop for the sub-range [begin, end), given the values the caller shares with it
+    using ParallelRangeGenerator = std::function<void(llvm::ArrayRef<llvm::Value*> sharedValues, llvm::Value* begin, llvm::Value* end)>;
+    // a loop body moved into its own function, which the runtime calls with sub-ranges, see runtime/parallel.h
+    struct ParallelBody {
+        llvm::Function* mFunction = nullptr;
+        llvm::StructType* mContextType = nullptr;
+        // read in the parent function, they go in the context after the shared values
+        std::vector<llvm::Value*> mCapturedValues;
+    };
+
+    // evaluates the i32 bounds once and widens them to the i64 the induction variable uses
+    bool _generateForRange(ForNode& forLoop, llvm::Value*& start, llvm::Value*& end);
+    llvm::Value* _generateForBody(ForNode& forLoop, llvm::PHINode* induction, llvm::BasicBlock* afterBlock);
+    // returns the combined value when given a reduction, otherwise nullptr
+    llvm::Value* _generateCountedLoop(llvm::Value* start, llvm::Value* end, const llvm::Twine& name, const LoopBodyGenerator& generateBody, const ReduceNode* reduction = nullptr);
+    llvm::Value* _getReductionIdentity(ReductionKind kind, llvm::Value* value);
+    llvm::Value* _combineReduction(const ReduceNode& reduction, llvm::Value* accumulated, llvm::Value* value);
+    ParallelBody _outlineParallelBody(ForNode& forLoop, llvm::ArrayRef<llvm::Type*> sharedTypes, const ParallelRangeGenerator& generateRange);
+    void _callParallelBody(const ParallelBody& body, llvm::ArrayRef<llvm::Value*> sharedValues, llvm::Value* begin, llvm::Value* end, size_t grainSize, bool deterministic);
+
+private:
+    // SSA construction for register variables, following "Simple and Efficient Construction of SSA Form" (Braun et al.)
+    //  - a block is sealed once all of its predecessors are known, reads in unsealed blocks get placeholder phis
+    struct RegisterInfo {
+        llvm::Type* mType;
+        std::string_view mName;
+    };
+    std::vector<RegisterInfo> mRegisters;
+    std::unordered_map<llvm::BasicBlock*, std::unordered_map<size_t, llvm::WeakTrackingVH>> mCurrentDefinitions;
+    std::unordered_map<llvm::BasicBlock*, std::vector<std::pair<size_t, llvm::PHINode*>>> mIncompletePhis;
+    std::unordered_set<llvm::BasicBlock*> mSealedBlocks;
+
+    void _writeRegister(size_t registerId, llvm::BasicBlock* block, llvm::Value* value);
+    llvm::Value* _readRegister(size_t registerId, llvm::BasicBlock* block);
+    llvm::Value* _readRegisterRecursive(size_t registerId, llvm::BasicBlock* block);
+    llvm::PHINode* _createRegisterPhi(size_t registerId, llvm::BasicBlock* block);
+    llvm::Value* _addPhiOperands(size_t registerId, llvm::PHINode* phi);
+    llvm::Value* _tryRemoveTrivialPhi(llvm::PHINode* phi);
+    void _sealBlock(llvm::BasicBlock* block);
 };
\ No newline at end of file
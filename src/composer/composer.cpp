@@ -1,122 +1,448 @@
 #include "composer.h"
 
-#include <fstream>
-#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
 
 #include "error/errorHandler.h"
 
 #include "parser/parser.h"
 #include "codegen/codegen.h"
+#include "optimizer/optimizer.h"
 #include "builder/builder.h"
+#include "cache/buildCache.h"
+#include "jit/jit.h"
+#include "linker/linker.h"
 
-#include "llvm/Analysis/LoopAnalysisManager.h"
-#include "llvm/Analysis/CGSCCPassManager.h"
-#include "llvm/IR/PassManager.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/IR/Verifier.h"
-#include "llvm/Passes/PassBuilder.h"
-
-//////////////////////////////////////////////////////////////
-// This stuff should be platform specific
-#include <windows.h>
-//////////////////////////////////////////////////////////////
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/IPO/Internalize.h"
 
 namespace {
-    std::string _sourceToObjectFileName(const std::string& sourceName) {
+    // the first partition keeps the plain name, so unpartitioned builds look the same as before
+    std::string _sourceToObjectFileName(const std::string& sourceName, unsigned int partition) {
         constexpr size_t velvetSourceFileExtensionSize = 2;
-        return sourceName.substr(0, sourceName.size() - velvetSourceFileExtensionSize) + "o";
+        const std::string baseName = sourceName.substr(0, sourceName.size() - velvetSourceFileExtensionSize);
+        return partition == 0 ? baseName + "o" : baseName + std::to_string(partition) + ".o";
+    }
+
+    // runs task(0) .. task(count - 1) at the same time, task(0) on the calling thread
+    void _runInParallel(size_t count, const std::function<void(size_t)>& task) {
+        std::vector<std::thread> threads;
+        threads.reserve(count > 0 ? count - 1 : 0);
+        for (size_t index = 1; index < count; ++index) {
+            threads.emplace_back(task, index);
+        }
+        if (count > 0) {
+            task(0);
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // everything a single file produces, held on to so it can be reported in a stable order
+    struct FileBuildResult {
+        ErrorHandler mErrorHandler = ErrorHandler(true);
+        std::string mIR;
+        std::vector<std::string> mObjectFiles;
+        std::vector<llvm::orc::ThreadSafeModule> mModules;
+        std::vector<std::unique_ptr<llvm::MemoryBuffer>> mCachedObjects;
+        // pre link bitcode, when building with link time optimization
+        std::vector<std::unique_ptr<llvm::MemoryBuffer>> mBitcode;
+    };
+
+    // one slice of a file's functions, generated and optimized on its own thread with its own context
+    struct ModulePartition {
+        ErrorHandler mErrorHandler = ErrorHandler(true);
+        std::unique_ptr<CodeGenerator> mGenerator;
+        std::string mIR;
+        std::optional<llvm::orc::ThreadSafeModule> mModule;
+    };
+
+    // verifies and optimizes everything the generator produced
+    //  - returns the module together with the context that owns it, or nothing if the module isn't valid
+    std::optional<llvm::orc::ThreadSafeModule> _finishModule(CodeGenerator& generator, const std::string& name, TargetBuilder& builder, Optimizer& optimizer, ErrorHandler& errorHandler, std::string* irOutput) {
+        if (errorHandler.hasError()) {
+            return std::nullopt;
+        }
+        if (irOutput) {
+            llvm::raw_string_ostream irStream(*irOutput);
+            generator.getModule()->print(irStream, nullptr);
+        }
+        std::string verifyOutput;
+        llvm::raw_string_ostream verifyStream(verifyOutput);
+        if (llvm::verifyModule(*generator.getModule().get(), &verifyStream)) {
+            // optimization passes assume valid IR, so don't try to go any further with this module
+            if (irOutput) {
+                *irOutput += verifyStream.str();
+            }
+            errorHandler.logError("Generated code for " + name + " failed verification");
+            return std::nullopt;
+        }
+
+        // optimization---------------
+        builder.prepareModule(*generator.getModule().get());
+        optimizer.optimizeModule(*generator.getModule().get());
+
+        return llvm::orc::ThreadSafeModule(std::move(generator.getModule()), std::move(generator.getContext()));
+    }
+
+    // emits every module to its own object file, each on its own thread
+    bool _buildObjectFiles(std::vector<llvm::orc::ThreadSafeModule>& modules, const std::vector<std::string>& fileNames, PartitionTargets& targets, ErrorHandler& errorHandler) {
+        std::vector<ErrorHandler> errorHandlers(modules.size(), ErrorHandler(true));
+        std::vector<char> built(modules.size(), false);
+        _runInParallel(modules.size(), [&](size_t index) {
+            built[index] = targets.getBuilder(index).buildModule(*modules[index].getModuleUnlocked(), fileNames[index], errorHandlers[index]);
+        });
+        for (const ErrorHandler& handler : errorHandlers) {
+            errorHandler.logErrors(handler);
+        }
+        return std::all_of(built.begin(), built.end(), [](char success) { return success; });
+    }
+
+    std::unique_ptr<llvm::MemoryBuffer> _writeBitcode(const llvm::Module& module, const std::string& name) {
+        llvm::SmallVector<char, 0> bitcode;
+        llvm::raw_svector_ostream output(bitcode);
+        llvm::WriteBitcodeToFile(module, output);
+        return llvm::MemoryBuffer::getMemBufferCopy(llvm::StringRef(bitcode.data(), bitcode.size()), name);
+    }
+
+    bool _writeObjectFile(const std::string& filename, llvm::MemoryBufferRef object) {
+        std::error_code errorCode;
+        llvm::raw_fd_ostream output(filename, errorCode, llvm::sys::fs::OF_None);
+        if (errorCode) {
+            return false;
+        }
+        output << object.getBuffer();
+        output.close();
+        if (output.has_error()) {
+            output.clear_error();
+            return false;
+        }
+        return true;
+    }
+
+    void _buildFile(const std::string& filename, const BuildOptions& options, PartitionTargets& targets, BuildCache* cache, FileBuildResult& result) {
+        ErrorHandler& errorHandler = result.mErrorHandler;
+        // large files are memory mapped, anything else is read into a buffer once
+        //  - the lexer and parser work on this buffer directly, so it is the only copy of the source
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> inputFile = llvm::MemoryBuffer::getFile(filename, false, false);
+        if (!inputFile) {
+            errorHandler.logError("Could not open file " + filename + ": " + inputFile.getError().message());
+            return;
+        }
+        const std::string_view contents(inputFile.get()->getBufferStart(), inputFile.get()->getBufferSize());
+        const unsigned int numPartitions = std::max(1u, options.mCodegenPartitions);
+        std::vector<std::string> outputFileNames;
+        for (unsigned int partition = 0; partition < numPartitions; ++partition) {
+            outputFileNames.push_back(_sourceToObjectFileName(filename, partition));
+        }
+
+        // a cache hit skips the frontend and backend entirely, but only if every partition is there
+        std::string cacheKey = "";
+        if (cache) {
+            cacheKey = BuildCache::computeKey(contents, options);
+            std::vector<std::unique_ptr<llvm::MemoryBuffer>> objects;
+            for (unsigned int partition = 0; partition < numPartitions; ++partition) {
+                std::unique_ptr<llvm::MemoryBuffer> object = cache->lookup(BuildCache::getPartitionKey(cacheKey, partition));
+                if (!object) {
+                    break;
+                }
+                objects.push_back(std::move(object));
+            }
+            if (objects.size() == numPartitions) {
+                if (options.mLinkTimeOptimization) {
+                    result.mBitcode = std::move(objects);
+                    return;
+                }
+                if (options.mRunJIT) {
+                    result.mCachedObjects = std::move(objects);
+                    return;
+                }
+                // if the objects can't be written out they're compiled again like any other miss
+                bool written = true;
+                for (unsigned int partition = 0; partition < numPartitions && written; ++partition) {
+                    written = _writeObjectFile(outputFileNames[partition], objects[partition]->getMemBufferRef());
+                }
+                if (written) {
+                    result.mObjectFiles = std::move(outputFileNames);
+                    return;
+                }
+            }
+        }
+
+        // TODO: Print only via debug flag
+        std::optional<std::vector<llvm::orc::ThreadSafeModule>> modules = Composer::compileModules(contents, filename, options, targets, errorHandler, &result.mIR);
+        if (!modules.has_value()) {
+            return;
+        }
+
+        // the modules have to be linked together before anything else happens to them
+        //  - they live in different contexts, bitcode is how they get into the context of the linked module
+        if (options.mLinkTimeOptimization) {
+            for (unsigned int partition = 0; partition < numPartitions; ++partition) {
+                std::unique_ptr<llvm::MemoryBuffer> bitcode = _writeBitcode(*modules.value()[partition].getModuleUnlocked(), filename);
+                if (cache) {
+                    cache->store(BuildCache::getPartitionKey(cacheKey, partition), bitcode->getMemBufferRef());
+                }
+                result.mBitcode.push_back(std::move(bitcode));
+            }
+            return;
+        }
+
+        // the JIT does its own codegen, it only needs the modules and the contexts that own them
+        //  - the JIT looks cache entries up by module identifier, so the keys go there
+        if (options.mRunJIT) {
+            if (cache) {
+                for (unsigned int partition = 0; partition < numPartitions; ++partition) {
+                    modules.value()[partition].getModuleUnlocked()->setModuleIdentifier(BuildCache::getPartitionKey(cacheKey, partition));
+                }
+            }
+            result.mModules = std::move(modules.value());
+            return;
+        }
+
+        // object file output---------------
+        if (!_buildObjectFiles(modules.value(), outputFileNames, targets, errorHandler)) {
+            return;
+        }
+        result.mObjectFiles = outputFileNames;
+        if (cache) {
+            for (unsigned int partition = 0; partition < numPartitions; ++partition) {
+                llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> object = llvm::MemoryBuffer::getFile(outputFileNames[partition], false, false);
+                if (object) {
+                    cache->store(BuildCache::getPartitionKey(cacheKey, partition), object.get()->getMemBufferRef());
+                }
+            }
+        }
+    }
+}
+
+PartitionTargets::PartitionTargets(const BuildOptions& options, ErrorHandler& errorHandler) {
+    const size_t numPartitions = std::max(1u, options.mCodegenPartitions);
+    mBuilders.reserve(numPartitions);
+    mOptimizers.reserve(numPartitions);
+    for (size_t partition = 0; partition < numPartitions; ++partition) {
+        mBuilders.emplace_back(std::make_unique<TargetBuilder>(options, errorHandler));
+        mOptimizers.emplace_back(std::make_unique<Optimizer>(options.mOptimizationLevel, mBuilders.back()->getTargetMachine(), options.mLinkTimeOptimization));
+    }
+}
+
+PartitionTargets::~PartitionTargets() = default;
+
+TargetBuilder& PartitionTargets::getBuilder(size_t partition) {
+    return *mBuilders[partition];
+}
+
+Optimizer& PartitionTargets::getOptimizer(size_t partition) {
+    return *mOptimizers[partition];
+}
+
+std::optional<std::vector<llvm::orc::ThreadSafeModule>> Composer::compileModules(std::string_view contents, const std::string& name, const BuildOptions& options, PartitionTargets& targets, ErrorHandler& errorHandler, std::string* irOutput) {
+    // Lexing/parsing------------
+    Parser parser(contents, errorHandler);
+    std::vector<FunctionDefinitionNode>& topLevelFuncs = parser.parseAll();
+    if (errorHandler.hasError()) {
+        return std::nullopt;
+    }
+
+    // codegen------------
+    // signatures are collected before any body is generated, so a function can call anything in the file
+    //  - definitions don't have to come before their uses, and functions can be (mutually) recursive
+    //  - every partition declares every function, calls into another partition become external references
+    //  - the declarations are all made up front, so a problem with one is only reported once
+    const size_t numPartitions = std::max(1u, options.mCodegenPartitions);
+    std::vector<ModulePartition> partitions(numPartitions);
+    for (ModulePartition& partition : partitions) {
+        partition.mGenerator = std::make_unique<CodeGenerator>(partition.mErrorHandler, options, parser.getIdentifiers());
+        for (FunctionDefinitionNode& func : topLevelFuncs) {
+            partition.mGenerator->declareFunction(func);
+        }
+        if (partition.mErrorHandler.hasError()) {
+            errorHandler.logErrors(partition.mErrorHandler);
+            return std::nullopt;
+        }
+    }
+    // contiguous ranges, so functions that are next to each other (and likely call each other) can still be inlined
+    _runInParallel(numPartitions, [&](size_t index) {
+        ModulePartition& partition = partitions[index];
+        const size_t begin = index * topLevelFuncs.size() / numPartitions;
+        const size_t end = (index + 1) * topLevelFuncs.size() / numPartitions;
+        for (size_t funcIndex = begin; funcIndex < end; ++funcIndex) {
+            // extern functions stay declarations, the linker (or the JIT) finds them in another file's object
+            if (!topLevelFuncs[funcIndex].mIsExtern) {
+                partition.mGenerator->generateFunctionCode(topLevelFuncs[funcIndex]);
+            }
+        }
+        partition.mModule = _finishModule(*partition.mGenerator, name, targets.getBuilder(index), targets.getOptimizer(index), partition.mErrorHandler, irOutput ? &partition.mIR : nullptr);
+        partition.mGenerator.reset();
+    });
+
+    std::vector<llvm::orc::ThreadSafeModule> modules;
+    for (ModulePartition& partition : partitions) {
+        if (irOutput) {
+            *irOutput += partition.mIR;
+        }
+        errorHandler.logErrors(partition.mErrorHandler);
+        if (partition.mModule.has_value()) {
+            modules.emplace_back(std::move(partition.mModule.value()));
+        }
+    }
+    if (modules.size() != numPartitions) {
+        return std::nullopt;
     }
+    return modules;
 }
 
-Composer::Composer(ErrorHandler& errorHandler) 
+Composer::Composer(ErrorHandler& errorHandler, const BuildOptions& options) 
     : mInputFiles() 
     , mObjectFiles() 
-    , mErrorHandler(errorHandler) {
-
+    , mErrorHandler(errorHandler)
+    , mOptions(options) {
+    TargetBuilder::resolveNativeTarget(mOptions);
+    if (!mOptions.mCacheDirectory.empty()) {
+        mCache = std::make_unique<BuildCache>(mOptions.mCacheDirectory);
+    }
 }
 
+Composer::~Composer() = default;
+
 void Composer::addInputFile(const std::string& fileName) {
     mInputFiles.emplace_back(fileName);
 }
 
 void Composer::buildAllFiles() {
-    // optimization passes
-    //  - consider moving this to a separate file
-    llvm::LoopAnalysisManager loopAnalysis;
-    llvm::FunctionAnalysisManager funcAnalysis;
-    llvm::CGSCCAnalysisManager CGSCCAnalysis;
-    llvm::ModuleAnalysisManager moduleAnalysis;
-
-    llvm::PassBuilder passBuilder;
-    passBuilder.registerLoopAnalyses(loopAnalysis);
-    passBuilder.registerFunctionAnalyses(funcAnalysis);
-    passBuilder.registerCGSCCAnalyses(CGSCCAnalysis);
-    passBuilder.registerModuleAnalyses(moduleAnalysis);
-    passBuilder.crossRegisterProxies(loopAnalysis, funcAnalysis, CGSCCAnalysis, moduleAnalysis);
-    // TODO: Optimization level should be passed in
-    llvm::ModulePassManager modulePassManager = passBuilder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O0);
-
-    for (const std::string& filename : mInputFiles) {
-        std::ifstream inputFile(filename);
-        if (inputFile.is_open()) {
-            std::stringstream buffer;
-            buffer << inputFile.rdbuf();
-            const std::string& contents = buffer.str();
-            
-            // Lexing/parsing------------
-            Parser parser(contents, mErrorHandler);
-            std::vector<FunctionDefinitionNode>& topLevelFuncs = parser.parseAll();
-            if (mErrorHandler.hasError()) {
-                continue;
-            }
+    const size_t numFiles = mInputFiles.size();
+    size_t numWorkers = mOptions.mJobs == 0 ? std::thread::hardware_concurrency() : mOptions.mJobs;
+    numWorkers = std::max<size_t>(1, std::min(numWorkers, numFiles));
 
-            // codegen------------
-            CodeGenerator generator(mErrorHandler);
-            for (FunctionDefinitionNode& func : topLevelFuncs) {
-                llvm::Function* funcIR = generator.generateFunctionCode(func);
-            }
-            if (mErrorHandler.hasError()) {
-                continue;
-            }
-            // modulePassManager.run(*generator.getModule().get(), moduleAnalysis);
-            // TODO: Print only via debug flag
-            // funcIR->print(llvm::errs());
-            generator.getModule()->print(llvm::errs(), nullptr);
-            if (llvm::verifyModule(*generator.getModule().get(), &llvm::errs())) {
-                // TODO: Handle verification failed
-            }
+    // target machines can't be shared between threads, so every worker gets its own builders and optimizers
+    //  - one of each per codegen partition, since a file's partitions are built on threads of their own
+    //  - these are reused for every file the worker picks up
+    std::vector<std::unique_ptr<PartitionTargets>> targets;
+    targets.reserve(numWorkers);
+    for (size_t index = 0; index < numWorkers; ++index) {
+        targets.emplace_back(std::make_unique<PartitionTargets>(mOptions, mErrorHandler));
+    }
+    if (mErrorHandler.hasError()) {
+        return;
+    }
+
+    std::vector<FileBuildResult> results(numFiles);
+    std::atomic<size_t> nextFile = 0;
+    auto worker = [&](size_t workerIndex) {
+        for (size_t index = nextFile++; index < numFiles; index = nextFile++) {
+            _buildFile(mInputFiles[index], mOptions, *targets[workerIndex], mCache.get(), results[index]);
+        }
+    };
+    if (numWorkers == 1) {
+        worker(0);
+    }
+    else {
+        std::vector<std::thread> threads;
+        threads.reserve(numWorkers);
+        for (size_t index = 0; index < numWorkers; ++index) {
+            threads.emplace_back(worker, index);
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
 
-            // object file output---------------
-            TargetBuilder builder;
-            std::string outputFileName = _sourceToObjectFileName(filename);
-            builder.buildModule(generator.getModule(), outputFileName);
-            mObjectFiles.emplace_back(std::move(outputFileName));
+    // report in input file order so the output doesn't depend on how the files were scheduled
+    for (FileBuildResult& result : results) {
+        llvm::errs() << result.mIR;
+        mErrorHandler.logErrors(result.mErrorHandler);
+        for (std::string& objectFile : result.mObjectFiles) {
+            mObjectFiles.emplace_back(std::move(objectFile));
+        }
+        for (llvm::orc::ThreadSafeModule& module : result.mModules) {
+            mModules.emplace_back(std::move(module));
+        }
+        for (std::unique_ptr<llvm::MemoryBuffer>& object : result.mCachedObjects) {
+            mCachedObjects.emplace_back(std::move(object));
         }
+        for (std::unique_ptr<llvm::MemoryBuffer>& bitcode : result.mBitcode) {
+            mBitcode.emplace_back(std::move(bitcode));
+        }
+    }
+
+    if (mOptions.mLinkTimeOptimization && !mErrorHandler.hasError()) {
+        _linkTimeOptimize(targets.front()->getBuilder(0));
     }
 }
 
-void Composer::generateExecutable() {
-    //////////////////////////////////////////////////////////////
-    // This stuff should be platform specific
-    const wchar_t* clang = L"clang";
-    // TODO: Lots of stuff to improve here
-    //  - custom output name
-    //  - perhaps want to allow passing '-v' to clang
-    std::wstring commandLine = std::wstring(clang) + L" -o main.exe";
-    for (const std::string& filename : mObjectFiles) {
-        commandLine += L" " + std::wstring(filename.begin(), filename.end());
-    }
-
-    // CreateProcess parameters
-    STARTUPINFO startupInfo = { sizeof(startupInfo) };
-    PROCESS_INFORMATION processInfo;
-    // Create the process
-    if (CreateProcess(nullptr, const_cast<LPWSTR>(commandLine.c_str()), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startupInfo, &processInfo)) {
-        WaitForSingleObject(processInfo.hProcess, INFINITE);
-        CloseHandle(processInfo.hProcess);
-        CloseHandle(processInfo.hThread);
+void Composer::_linkTimeOptimize(TargetBuilder& builder) {
+    // nothing to link, without any input there's no program and linking (or running) it fails as it would without -flto
+    if (mBitcode.empty()) {
+        return;
     }
-    else {
-        mErrorHandler.logError("Failed to start clang linking process");
+    auto context = std::make_unique<llvm::LLVMContext>();
+    auto linkedModule = std::make_unique<llvm::Module>("velvet", *context);
+    llvm::Linker linker(*linkedModule);
+    for (std::unique_ptr<llvm::MemoryBuffer>& bitcode : mBitcode) {
+        llvm::Expected<std::unique_ptr<llvm::Module>> module = llvm::parseBitcodeFile(bitcode->getMemBufferRef(), *context);
+        if (!module) {
+            mErrorHandler.logError("Could not read bitcode for " + bitcode->getBufferIdentifier().str() + ": " + llvm::toString(module.takeError()));
+            return;
+        }
+        if (linker.linkInModule(std::move(module.get()))) {
+            mErrorHandler.logError("Could not link " + bitcode->getBufferIdentifier().str() + " into the program");
+            return;
+        }
     }
-    //////////////////////////////////////////////////////////////
+    mBitcode.clear();
+
+    // this is the whole program, so nothing but main has to stay visible
+    //  - lets the optimizer inline and drop every other function as it sees fit
+    llvm::internalizeModule(*linkedModule, [](const llvm::GlobalValue& value) {
+        return value.getName() == "main";
+    });
+    builder.prepareModule(*linkedModule);
+    Optimizer optimizer(mOptions.mOptimizationLevel, builder.getTargetMachine(), true);
+    optimizer.optimizeLinkedModule(*linkedModule);
+
+    if (mOptions.mRunJIT) {
+        mModules.emplace_back(std::move(linkedModule), std::move(context));
+        return;
+    }
+    // named after the executable, the whole program ends up in this one object
+    const std::string linkedFileName = ExecutableLinker::getOutputFileName(mOptions.mOutputFile) + ".lto.o";
+    if (builder.buildModule(*linkedModule, linkedFileName, mErrorHandler)) {
+        mObjectFiles.push_back(linkedFileName);
+    }
+}
+
+int Composer::runMain() {
+    JITRunner runner(mOptions, mErrorHandler, mCache.get());
+    for (llvm::orc::ThreadSafeModule& module : mModules) {
+        if (!runner.addModule(std::move(module))) {
+            return 1;
+        }
+    }
+    mModules.clear();
+    for (std::unique_ptr<llvm::MemoryBuffer>& object : mCachedObjects) {
+        if (!runner.addObject(std::move(object))) {
+            return 1;
+        }
+    }
+    mCachedObjects.clear();
+    if (mErrorHandler.hasError()) {
+        return 1;
+    }
+    return runner.runMain();
+}
+
+bool Composer::generateExecutable() {
+    ExecutableLinker linker(mErrorHandler);
+    return linker.link(mObjectFiles, mOptions.mOutputFile);
 }
\ No newline at end of file
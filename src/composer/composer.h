@@ -1,19 +1,63 @@
 #pragma once
 
+#include <memory>
+#include <optional>
 #include <vector>
 #include <string>
+#include <string_view>
 
+#include "options/options.h"
+
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+class BuildCache;
 class ErrorHandler;
+class TargetBuilder;
+class Optimizer;
+
+// a target builder and optimizer for every codegen partition of a file
+//  - target machines can't be shared between threads, and every partition is finished on its own thread
+//  - meant to be created once per worker and reused for every file it builds, setting these up isn't cheap
+class PartitionTargets {
+    std::vector<std::unique_ptr<TargetBuilder>> mBuilders;
+    std::vector<std::unique_ptr<Optimizer>> mOptimizers;
+public:
+    PartitionTargets(const BuildOptions& options, ErrorHandler& errorHandler);
+    ~PartitionTargets();
+
+    TargetBuilder& getBuilder(size_t partition);
+    Optimizer& getOptimizer(size_t partition);
+};
 
 class Composer {
     std::vector<std::string> mInputFiles;
     std::vector<std::string> mObjectFiles;
+    // modules are kept in memory instead of written out as object files when running through the JIT
+    std::vector<llvm::orc::ThreadSafeModule> mModules;
+    // JIT objects for files that were found in the build cache
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> mCachedObjects;
+    // every file's pre link bitcode, linked and optimized as a whole once all files are built
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> mBitcode;
+    std::unique_ptr<BuildCache> mCache;
     ErrorHandler& mErrorHandler;
+    BuildOptions mOptions;
 public:
-    Composer(ErrorHandler& errorHandler);
+    Composer(ErrorHandler& errorHandler, const BuildOptions& options);
+    ~Composer();
 
     void addInputFile(const std::string& fileName);
 
     void buildAllFiles();
-    void generateExecutable();
+    // returns false if the executable couldn't be linked, the reason is logged to the error handler
+    bool generateExecutable();
+    int runMain();
+
+    // lexes, parses, generates and optimizes a single source into one module per codegen partition
+    //  - returns nothing if anything went wrong, the errors are logged to the error handler
+    //  - the unoptimized IR is written to irOutput if one is given
+    //  - contents are only read while compiling, nothing in the modules refers back to them
+    static std::optional<std::vector<llvm::orc::ThreadSafeModule>> compileModules(std::string_view contents, const std::string& name, const BuildOptions& options, PartitionTargets& targets, ErrorHandler& errorHandler, std::string* irOutput);
+private:
+    void _linkTimeOptimize(TargetBuilder& builder);
 };
\ No newline at end of file
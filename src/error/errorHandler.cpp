@@ -4,11 +4,26 @@
 
 ErrorHandler::ErrorHandler() {}
 
+ErrorHandler::ErrorHandler(bool deferOutput) : mDeferOutput(deferOutput) {}
+
 bool ErrorHandler::hasError() const {
     return mErrorFound;
 }
 
+const std::vector<std::string>& ErrorHandler::getErrors() const {
+    return mMessages;
+}
+
 void ErrorHandler::logError(const std::string& message) {
     mErrorFound = true;
-    std::cout << "ERROR: " << message << std::endl;
+    mMessages.emplace_back(message);
+    if (!mDeferOutput) {
+        std::cout << "ERROR: " << message << std::endl;
+    }
+}
+
+void ErrorHandler::logErrors(const ErrorHandler& other) {
+    for (const std::string& message : other.mMessages) {
+        logError(message);
+    }
 }
\ No newline at end of file
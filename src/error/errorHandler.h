@@ -1,12 +1,20 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 class ErrorHandler {
     bool mErrorFound = false;
+    // deferred handlers hold onto their messages instead of printing them straight away
+    bool mDeferOutput = false;
+    std::vector<std::string> mMessages;
 public:
     ErrorHandler();
+    explicit ErrorHandler(bool deferOutput);
 
     bool hasError() const;
+    const std::vector<std::string>& getErrors() const;
     void logError(const std::string& message);
+    // logs every error recorded by another handler, in the order they were recorded
+    void logErrors(const ErrorHandler& other);
 };
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include "jit.h"
+
+#include "builder/builder.h"
+#include "runtime/parallel.h"
+
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/Support/Host.h"
+
+JITRunner::JITRunner(const BuildOptions& options, ErrorHandler& errorHandler, llvm::ObjectCache* objectCache)
+    : mJIT()
+    , mErrorHandler(errorHandler)
+{
+    TargetBuilder::initializeTargets();
+
+    // match the target the optimizer was told about when the modules were generated
+    llvm::orc::JITTargetMachineBuilder targetMachineBuilder(llvm::Triple(llvm::sys::getDefaultTargetTriple()));
+    targetMachineBuilder.setCPU(options.mTargetCPU);
+    targetMachineBuilder.setFeatures(options.mTargetFeatures);
+    targetMachineBuilder.setCodeGenOptLevel(TargetBuilder::getCodeGenOptLevel(options.mOptimizationLevel));
+    targetMachineBuilder.setOptions(TargetBuilder::getTargetOptions(options));
+
+    llvm::orc::LLJITBuilder jitBuilder;
+    jitBuilder.setJITTargetMachineBuilder(std::move(targetMachineBuilder));
+    if (objectCache) {
+        // same compiler LLJIT uses by default, just with the cache hooked in so it can skip codegen
+        jitBuilder.setCompileFunctionCreator([objectCache](llvm::orc::JITTargetMachineBuilder machineBuilder)
+            -> llvm::Expected<std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+            llvm::Expected<std::unique_ptr<llvm::TargetMachine>> targetMachine = machineBuilder.createTargetMachine();
+            if (!targetMachine) {
+                return targetMachine.takeError();
+            }
+            return std::make_unique<llvm::orc::TMOwningSimpleCompiler>(std::move(targetMachine.get()), objectCache);
+        });
+    }
+    llvm::Expected<std::unique_ptr<llvm::orc::LLJIT>> jit = jitBuilder.create();
+    if (!jit) {
+        mErrorHandler.logError("Could not create JIT: " + llvm::toString(jit.takeError()));
+        return;
+    }
+    mJIT = std::move(jit.get());
+
+    const char globalPrefix = mJIT->getDataLayout().getGlobalPrefix();
+    llvm::Expected<std::unique_ptr<llvm::orc::DynamicLibrarySearchGenerator>> processSymbols = 
+        llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(globalPrefix);
+    if (!processSymbols) {
+        mErrorHandler.logError("Could not load process symbols for JIT: " + llvm::toString(processSymbols.takeError()));
+        return;
+    }
+    mJIT->getMainJITDylib().addGenerator(std::move(processSymbols.get()));
+
+    // the runtime is linked into the compiler, but its symbols aren't necessarily exported from the process
+    llvm::orc::SymbolMap runtimeSymbols;
+    runtimeSymbols[mJIT->mangleAndIntern("velvet_parallel_for")] = 
+        llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(&velvet_parallel_for), llvm::JITSymbolFlags::Exported);
+    if (llvm::Error error = mJIT->getMainJITDylib().define(llvm::orc::absoluteSymbols(std::move(runtimeSymbols)))) {
+        mErrorHandler.logError("Could not add runtime symbols to JIT: " + llvm::toString(std::move(error)));
+    }
+}
+
+bool JITRunner::addModule(llvm::orc::ThreadSafeModule module) {
+    if (!mJIT) {
+        return false;
+    }
+    if (llvm::Error error = mJIT->addIRModule(std::move(module))) {
+        mErrorHandler.logError("Could not add module to JIT: " + llvm::toString(std::move(error)));
+        return false;
+    }
+    return true;
+}
+
+bool JITRunner::addObject(std::unique_ptr<llvm::MemoryBuffer> object) {
+    if (!mJIT) {
+        return false;
+    }
+    if (llvm::Error error = mJIT->addObjectFile(std::move(object))) {
+        mErrorHandler.logError("Could not add object to JIT: " + llvm::toString(std::move(error)));
+        return false;
+    }
+    return true;
+}
+
+void* JITRunner::getFunctionAddress(const std::string& name) {
+    if (!mJIT) {
+        return nullptr;
+    }
+    llvm::orc::ExecutionSession& session = mJIT->getExecutionSession();
+    auto symbol = session.lookup({ &mJIT->getMainJITDylib() }, mJIT->mangleAndIntern(name));
+    if (!symbol) {
+        mErrorHandler.logError("Could not find function " + name + ": " + llvm::toString(symbol.takeError()));
+        return nullptr;
+    }
+    return llvm::jitTargetAddressToPointer<void*>(symbol->getAddress());
+}
+
+int JITRunner::runMain() {
+    using MainFunction = int (*)();
+    MainFunction mainFunction = reinterpret_cast<MainFunction>(getFunctionAddress("main"));
+    if (!mainFunction) {
+        return 1;
+    }
+    return mainFunction();
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <memory>
+
+#include "error/errorHandler.h"
+#include "options/options.h"
+
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+// Runs generated modules in process instead of going through object files and a linker
+//  - externals like printf are resolved against the symbols of the compiler process itself
+//  - the velvet runtime is linked into the compiler, so calls into it go straight to the compiler's copy
+class JITRunner {
+    std::unique_ptr<llvm::orc::LLJIT> mJIT;
+    ErrorHandler& mErrorHandler;
+public:
+    // the object cache is optional, if one is given it has to outlive the runner
+    JITRunner(const BuildOptions& options, ErrorHandler& errorHandler, llvm::ObjectCache* objectCache);
+
+    bool addModule(llvm::orc::ThreadSafeModule module);
+    // adds an already compiled object, e.g. one that came out of the build cache
+    bool addObject(std::unique_ptr<llvm::MemoryBuffer> object);
+    // compiles whatever the symbol needs on first lookup, returns nullptr if it can't be found
+    void* getFunctionAddress(const std::string& name);
+    // returns the exit code of the program, or 1 if main couldn't be run
+    int runMain();
+};
\ No newline at end of file
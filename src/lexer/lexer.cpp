@@ -1,199 +1,381 @@
 #include "lexer.h"
 
-#include <unordered_map>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+
+// the wide scanning paths need at least SSE2, which every x86-64 target has
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VELVET_LEXER_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(VELVET_LEXER_SSE2) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 namespace {
-    enum class LexType {
-        NONE,
-        ID,
-        NUM,
-        SYMBOL,
-        COMMENT
+    // a character can be in more than one class, e.g. letters are identifier starts and identifier characters
+    enum CharClass : uint8_t {
+        CLASS_IDENTIFIER_START = 1 << 0,
+        CLASS_IDENTIFIER = 1 << 1,
+        // digits and '.', the characters numbers are made of
+        CLASS_NUMBER = 1 << 2,
+        // characters that combine into multi character operators
+        CLASS_SYMBOL = 1 << 3,
+        // characters that are always a token on their own
+        CLASS_SINGLE = 1 << 4,
+        // newlines aren't included since they have to be counted
+        CLASS_WHITESPACE = 1 << 5
     };
 
-    inline bool _isAlphabet(char c) {
-        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
-    }
-
-    inline bool _isNumeric(char c) {
-        return c >= '0' && c <= '9';
-    }
-
-    inline bool _isAlphaNumeric(char c) {
-        return _isAlphabet(c) || (c >= 'a' && c <= 'z') || _isNumeric(c);
+    constexpr std::array<uint8_t, 256> _buildCharClassTable() {
+        std::array<uint8_t, 256> table = {};
+        for (int c = 'a'; c <= 'z'; ++c) {
+            table[c] |= CLASS_IDENTIFIER_START | CLASS_IDENTIFIER;
+        }
+        for (int c = 'A'; c <= 'Z'; ++c) {
+            table[c] |= CLASS_IDENTIFIER_START | CLASS_IDENTIFIER;
+        }
+        for (int c = '0'; c <= '9'; ++c) {
+            table[c] |= CLASS_IDENTIFIER | CLASS_NUMBER;
+        }
+        table['_'] |= CLASS_IDENTIFIER_START | CLASS_IDENTIFIER;
+        table['.'] |= CLASS_NUMBER;
+        for (char c : { '=', '!', '>', '<', '&', '|' }) {
+            table[static_cast<unsigned char>(c)] |= CLASS_SYMBOL;
+        }
+        for (char c : { ',', ':', ';', '(', ')', '{', '}', '[', ']', '@', '+', '-', '*', '/' }) {
+            table[static_cast<unsigned char>(c)] |= CLASS_SINGLE;
+        }
+        for (char c : { ' ', '\t', '\r' }) {
+            table[static_cast<unsigned char>(c)] |= CLASS_WHITESPACE;
+        }
+        return table;
     }
+    constexpr std::array<uint8_t, 256> charClassTable = _buildCharClassTable();
 
-    inline bool _isValidIdentifierStart(char c) {
-        return _isAlphabet(c) || c == '_';
+    // only meaningful for characters in CLASS_SINGLE
+    constexpr std::array<Token, 256> _buildSingleCharTable() {
+        std::array<Token, 256> table = {};
+        table[','] = Token::COMMA;
+        table[':'] = Token::COLON;
+        table[';'] = Token::SEMICOLON;
+        table['('] = Token::LEFT_PARENTHESIS;
+        table[')'] = Token::RIGHT_PARENTHESIS;
+        table['{'] = Token::LEFT_BRACKET;
+        table['}'] = Token::RIGHT_BRACKET;
+        table['['] = Token::LEFT_SQUARE_BRACKET;
+        table[']'] = Token::RIGHT_SQUARE_BRACKET;
+        table['@'] = Token::FUNC_RETURN;
+        table['+'] = Token::PLUS;
+        table['-'] = Token::MINUS;
+        table['*'] = Token::MULTIPLY;
+        table['/'] = Token::DIVIDE;
+        return table;
     }
+    constexpr std::array<Token, 256> singleCharTable = _buildSingleCharTable();
 
-    inline bool _isValidIdentifierChar(char c) {
-        return _isAlphaNumeric(c) || c == '_';
+    inline uint8_t _getCharClass(char c) {
+        return charClassTable[static_cast<unsigned char>(c)];
     }
 
-    inline bool _isUniqueSymbol(char c) {
-        return c == '=' || c == '!' || c == '>' || c == '<' || c == '&' || c == '|';
-    }
+    struct Keyword {
+        std::string_view mText;
+        Token mToken;
+    };
 
-    const std::unordered_map<std::string, Token> keywordMap = {
+    constexpr std::array<Keyword, 21> keywords = {{
         { "def", Token::FUNC_DEF },
+        { "extern", Token::EXTERN },
+        { "fastmath", Token::FASTMATH },
+        { "contract", Token::CONTRACT },
         { "var", Token::VAR_DEF },
         { "if", Token::IF },
         { "then", Token::THEN },
         { "else", Token::ELSE },
         { "loop", Token::LOOP },
+        { "for", Token::FOR },
+        { "parallel", Token::PARALLEL },
+        { "reduce", Token::REDUCE },
+        { "in", Token::IN },
         { "break", Token::BREAK },
         { "arrdecay", Token::ARRAY_DECAY },
         // types
         { "i32", Token::TYPE_I32 },
         { "f32", Token::TYPE_F32 },
-        { "bool", Token::TYPE_BOOL }
-    };
+        { "bool", Token::TYPE_BOOL },
+        { "f32x4", Token::TYPE_F32X4 },
+        { "f32x8", Token::TYPE_F32X8 },
+        { "i32x8", Token::TYPE_I32X8 }
+    }};
 
-    const std::unordered_map<char, Token> singleCharMap = {
-        { ',', Token::COMMA },
-        { ':', Token::COLON },
-        { ';', Token::SEMICOLON },
-        { '(', Token::LEFT_PARENTHESIS },
-        { ')', Token::RIGHT_PARENTHESIS },
-        { '{', Token::LEFT_BRACKET },
-        { '}', Token::RIGHT_BRACKET },
-        { '[', Token::LEFT_SQUARE_BRACKET },
-        { ']', Token::RIGHT_SQUARE_BRACKET },
-        { '@', Token::FUNC_RETURN },
-        { '+', Token::PLUS },
-        { '-', Token::MINUS },
-        { '*', Token::MULTIPLY },
-        { '/', Token::DIVIDE }
-    };
+    // perfect hash of the keywords built from their length and first and last characters
+    //  - the multipliers are searched for at compile time, so adding a keyword can never introduce a collision
+    //  - anything that hashes to a slot still has to be compared against the keyword in it
+    constexpr size_t keywordTableSize = 128;
+    constexpr size_t keywordMinLength = 2;
+    constexpr size_t keywordMaxLength = 8;
+    constexpr uint32_t keywordMaxMultiplier = 64;
 
-    const std::unordered_map<std::string, Token> symbolMap = {
-        { "=", Token::ASSIGN },
-        { "==", Token::EQUALS },
-        { "!=", Token::NOT_EQUALS },
-        { ">", Token::GREATER },
-        { ">=", Token::GREATER_EQUALS},
-        { "<", Token::LESS },
-        { "<=", Token::LESS_EQUALS},
-        { "&&", Token::AND },
-        { "||", Token::OR }
-    };
+    struct KeywordTable {
+        uint32_t mFirstMultiplier = 0;
+        uint32_t mLastMultiplier = 0;
+        // index into keywords, or -1 for an empty slot
+        std::array<int8_t, keywordTableSize> mSlots = {};
 
-    constexpr char commentSymbol = '#';
-    constexpr char commentEnd = '\n';
-}
-
-Lexer::Lexer(std::string input) 
-    : mTokens() 
-    , mCurrTokenIndex(0) 
-{
-    LexType currLexType = LexType::NONE;
-    std::string currToken = "";
-    for (const char c : input) {
-        if (c == commentSymbol) {
-            currLexType = LexType::COMMENT;
-        }
-        if (currLexType == LexType::NONE) {
-            if (_isValidIdentifierStart(c)) {
-                currLexType = LexType::ID;
-                currToken += c;
-            }
-            else if (_isNumeric(c) || c == '.') {
-                currLexType = LexType::NUM;
-                currToken += c;
-            }
-            else if (_isUniqueSymbol(c)) {
-                currLexType = LexType::SYMBOL;
-                currToken += c;
-            } else {
-                checkAndAddSingleToken(c);
-            }
+        constexpr size_t hash(std::string_view text) const {
+            const uint32_t first = static_cast<unsigned char>(text.front());
+            const uint32_t last = static_cast<unsigned char>(text.back());
+            return (first * mFirstMultiplier + last * mLastMultiplier + static_cast<uint32_t>(text.size())) % keywordTableSize;
         }
-        else if (currLexType == LexType::ID) {
-            if (_isValidIdentifierChar(c)) {
-                currToken += c;
-            }
-            else {
-                auto it = keywordMap.find(currToken);
-                if (it != keywordMap.end()) {
-                    mTokens.emplace_back(it->second, currToken);
+    };
+
+    constexpr KeywordTable _buildKeywordTable() {
+        for (uint32_t firstMultiplier = 1; firstMultiplier < keywordMaxMultiplier; ++firstMultiplier) {
+            for (uint32_t lastMultiplier = 1; lastMultiplier < keywordMaxMultiplier; ++lastMultiplier) {
+                KeywordTable table;
+                table.mFirstMultiplier = firstMultiplier;
+                table.mLastMultiplier = lastMultiplier;
+                for (int8_t& slot : table.mSlots) {
+                    slot = -1;
                 }
-                else {
-                    mTokens.emplace_back(Token::ID, currToken);
+                bool collision = false;
+                for (size_t index = 0; index < keywords.size() && !collision; ++index) {
+                    int8_t& slot = table.mSlots[table.hash(keywords[index].mText)];
+                    collision = slot != -1;
+                    slot = static_cast<int8_t>(index);
+                }
+                if (!collision) {
+                    return table;
                 }
-                currToken.clear();
-                currLexType = LexType::NONE;
-                checkAndAddSingleToken(c);
             }
         }
-        else if (currLexType == LexType::NUM) {
-            if (_isNumeric(c) || c == '.') {
-                currToken += c;
-            }
-            else {
-                mTokens.emplace_back(Token::NUM, currToken);
-                currToken.clear();
-                currLexType = LexType::NONE;
-                checkAndAddSingleToken(c);
+        return KeywordTable();
+    }
+    constexpr KeywordTable keywordTable = _buildKeywordTable();
+    static_assert(keywordTable.mFirstMultiplier != 0, "no collision free keyword hash, grow the keyword table");
+
+    constexpr bool _keywordLengthsInRange() {
+        for (const Keyword& keyword : keywords) {
+            if (keyword.mText.size() < keywordMinLength || keyword.mText.size() > keywordMaxLength) {
+                return false;
             }
         }
-        else if (currLexType == LexType::SYMBOL) {
-            if (_isUniqueSymbol(c)) {
-                currToken += c;
+        return true;
+    }
+    static_assert(_keywordLengthsInRange(), "keyword length bounds don't cover every keyword");
+
+    Token _lookupIdentifier(std::string_view text) {
+        if (text.size() < keywordMinLength || text.size() > keywordMaxLength) {
+            return Token::ID;
+        }
+        const int8_t slot = keywordTable.mSlots[keywordTable.hash(text)];
+        if (slot >= 0 && keywords[slot].mText == text) {
+            return keywords[slot].mToken;
+        }
+        return Token::ID;
+    }
+
+    // the operators are at most two characters long, so they're matched directly instead of hashed
+    std::optional<Token> _lookupSymbol(std::string_view text) {
+        if (text.size() == 1) {
+            switch (text[0]) {
+                case '=': return Token::ASSIGN;
+                case '>': return Token::GREATER;
+                case '<': return Token::LESS;
+                default: return std::nullopt;
             }
-            else {
-                auto it = symbolMap.find(currToken);
-                if (it != symbolMap.end()) {
-                    mTokens.emplace_back(it->second, currToken);
-                }
-                else {
-                    // TODO: Error?
-                }
-                currToken.clear();
-                if (_isAlphabet(c)) {
-                    currLexType = LexType::ID;
-                    currToken += c;
-                }
-                else if (_isNumeric(c)) {
-                    currLexType = LexType::NUM;
-                    currToken += c;
-                } else {
-                    checkAndAddSingleToken(c);
-                }
+        }
+        if (text.size() == 2 && text[1] == '=') {
+            switch (text[0]) {
+                case '=': return Token::EQUALS;
+                case '!': return Token::NOT_EQUALS;
+                case '>': return Token::GREATER_EQUALS;
+                case '<': return Token::LESS_EQUALS;
+                default: return std::nullopt;
             }
         }
-        else if (currLexType == LexType::COMMENT) {
-            if (c == '\n') {
-                currLexType = LexType::NONE;
+        if (text == "&&") {
+            return Token::AND;
+        }
+        if (text == "||") {
+            return Token::OR;
+        }
+        return std::nullopt;
+    }
+
+#ifdef VELVET_LEXER_SSE2
+    inline uint32_t _countTrailingZeros(uint32_t value) {
+#ifdef _MSC_VER
+        unsigned long index = 0;
+        _BitScanForward(&index, value);
+        return index;
+#else
+        return __builtin_ctz(value);
+#endif
+    }
+
+    // byte mask of the characters in [low, high]
+    //  - the compares are signed, so bytes past ascii come out negative and are never in an ascii range
+    inline __m128i _inRange(__m128i chars, char low, char high) {
+        return _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8(low - 1)), _mm_cmplt_epi8(chars, _mm_set1_epi8(high + 1)));
+    }
+
+    // returns the offset of the first byte not in the mask, or 16 if every byte is
+    inline uint32_t _firstMismatch(__m128i matches) {
+        const uint32_t mismatches = ~static_cast<uint32_t>(_mm_movemask_epi8(matches)) & 0xFFFF;
+        return mismatches == 0 ? 16 : _countTrailingZeros(mismatches);
+    }
+#endif
+
+    // the skip functions check 16 characters at a time where SSE2 is available, the rest is done through the class table
+    //  - wide loads only happen while 16 bytes remain, so they never read past the end of the buffer
+    size_t _skipIdentifierChars(std::string_view source, size_t position) {
+#ifdef VELVET_LEXER_SSE2
+        while (position + 16 <= source.size()) {
+            const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source.data() + position));
+            // setting the case bit folds upper case letters onto lower case without pulling any other character into range
+            __m128i matches = _inRange(_mm_or_si128(chars, _mm_set1_epi8(0x20)), 'a', 'z');
+            matches = _mm_or_si128(matches, _inRange(chars, '0', '9'));
+            matches = _mm_or_si128(matches, _mm_cmpeq_epi8(chars, _mm_set1_epi8('_')));
+            const uint32_t offset = _firstMismatch(matches);
+            position += offset;
+            if (offset < 16) {
+                return position;
             }
         }
+#endif
+        while (position < source.size() && (_getCharClass(source[position]) & CLASS_IDENTIFIER)) {
+            ++position;
+        }
+        return position;
     }
-    if (currToken.length() > 0) {
-        if (currLexType == LexType::ID) {
-            mTokens.emplace_back(Token::ID, currToken);
+
+    size_t _skipWhitespace(std::string_view source, size_t position) {
+#ifdef VELVET_LEXER_SSE2
+        while (position + 16 <= source.size()) {
+            const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source.data() + position));
+            __m128i matches = _mm_cmpeq_epi8(chars, _mm_set1_epi8(' '));
+            matches = _mm_or_si128(matches, _mm_cmpeq_epi8(chars, _mm_set1_epi8('\t')));
+            matches = _mm_or_si128(matches, _mm_cmpeq_epi8(chars, _mm_set1_epi8('\r')));
+            const uint32_t offset = _firstMismatch(matches);
+            position += offset;
+            if (offset < 16) {
+                return position;
+            }
         }
-        if (currLexType == LexType::NUM) {
-            mTokens.emplace_back(Token::NUM, currToken);
+#endif
+        while (position < source.size() && (_getCharClass(source[position]) & CLASS_WHITESPACE)) {
+            ++position;
         }
+        return position;
     }
-    mTokens.emplace_back(Token::TOK_EOF, "");
+
+    constexpr char commentSymbol = '#';
+    constexpr char commentEnd = '\n';
+}
+
+Lexer::Lexer(std::string_view input) 
+    : mSource(input)
+{
+    // the current token always has to be available
+    fillLookahead(1);
 }
 
 Token Lexer::getCurrToken() const {
-    return mTokens[mCurrTokenIndex].first;
+    return mLookahead[mLookaheadStart].mType;
+}
+
+std::string_view Lexer::getCurrTokenStr() const {
+    const TokenInfo& token = mLookahead[mLookaheadStart];
+    return mSource.substr(token.mOffset, token.mLength);
 }
 
-const std::string& Lexer::getCurrTokenStr() const {
-    return mTokens[mCurrTokenIndex].second;
+SourceLocation Lexer::getCurrTokenLocation() const {
+    return mLookahead[mLookaheadStart].mLocation;
 }
 
 void Lexer::consumeToken() {
-    mCurrTokenIndex++;
+    mLookaheadStart = (mLookaheadStart + 1) % lookaheadSize;
+    --mLookaheadCount;
+    fillLookahead(1);
+}
+
+Token Lexer::peekToken(size_t distance) {
+    assert(distance < lookaheadSize);
+    fillLookahead(distance + 1);
+    return mLookahead[(mLookaheadStart + distance) % lookaheadSize].mType;
+}
+
+// scans forward from the current position until a full token has been read
+//  - once the end of the input is reached every call returns an EOF token
+Lexer::TokenInfo Lexer::lexToken() {
+    // tokens are sliced straight out of the input, nothing is copied while scanning
+    while (mPosition < mSource.size()) {
+        const char c = mSource[mPosition];
+        const uint8_t charClass = _getCharClass(c);
+        const SourceLocation location{ mLine, static_cast<uint32_t>(mPosition - mLineStart + 1) };
+        const size_t start = mPosition;
+        if (charClass & CLASS_WHITESPACE) {
+            mPosition = _skipWhitespace(mSource, mPosition);
+        }
+        else if (c == '\n') {
+            ++mLine;
+            mLineStart = ++mPosition;
+        }
+        else if (c == commentSymbol) {
+            // the comment end is left for the next iteration so the line count stays right
+            const void* commentEndPosition = std::memchr(mSource.data() + mPosition, commentEnd, mSource.size() - mPosition);
+            mPosition = commentEndPosition ? static_cast<const char*>(commentEndPosition) - mSource.data() : mSource.size();
+        }
+        else if (charClass & CLASS_IDENTIFIER_START) {
+            mPosition = _skipIdentifierChars(mSource, mPosition + 1);
+            return makeToken(_lookupIdentifier(mSource.substr(start, mPosition - start)), start, location);
+        }
+        else if (c == '.' && mPosition + 1 < mSource.size() && mSource[mPosition + 1] == '.') {
+            mPosition += 2;
+            return makeToken(Token::RANGE, start, location);
+        }
+        else if (charClass & CLASS_NUMBER) {
+            // a '..' ends the number, so ranges like 0..10 don't need spaces
+            while (mPosition < mSource.size() && (_getCharClass(mSource[mPosition]) & CLASS_NUMBER)
+                && !(mSource[mPosition] == '.' && mPosition + 1 < mSource.size() && mSource[mPosition + 1] == '.')) {
+                ++mPosition;
+            }
+            return makeToken(Token::NUM, start, location);
+        }
+        else if (charClass & CLASS_SYMBOL) {
+            while (mPosition < mSource.size() && (_getCharClass(mSource[mPosition]) & CLASS_SYMBOL)) {
+                ++mPosition;
+            }
+            std::optional<Token> symbol = _lookupSymbol(mSource.substr(start, mPosition - start));
+            if (symbol.has_value()) {
+                return makeToken(symbol.value(), start, location);
+            }
+            else {
+                // TODO: Error?
+            }
+        }
+        else {
+            ++mPosition;
+            if (charClass & CLASS_SINGLE) {
+                return makeToken(singleCharTable[static_cast<unsigned char>(c)], start, location);
+            }
+        }
+    }
+    return makeToken(Token::TOK_EOF, mPosition, SourceLocation{ mLine, static_cast<uint32_t>(mPosition - mLineStart + 1) });
+}
+
+Lexer::TokenInfo Lexer::makeToken(Token type, size_t start, SourceLocation location) const {
+    return TokenInfo{ type, static_cast<uint32_t>(start), static_cast<uint32_t>(mPosition - start), location };
 }
 
-void Lexer::checkAndAddSingleToken(char c) {
-    auto it = singleCharMap.find(c);
-    if (it != singleCharMap.end()) {
-        mTokens.emplace_back(it->second, std::string(1, c));
+void Lexer::fillLookahead(size_t count) {
+    while (mLookaheadCount < count) {
+        mLookahead[(mLookaheadStart + mLookaheadCount) % lookaheadSize] = lexToken();
+        ++mLookaheadCount;
     }
 }
\ No newline at end of file
@@ -1,20 +1,49 @@
 #pragma once
 
-#include <string>
-#include <vector>
-#include <utility>
+#include <array>
+#include <cstdint>
+#include <string_view>
 
 #include "lexer/tokens.h"
 
+struct SourceLocation {
+    uint32_t mLine;
+    uint32_t mColumn;
+};
+
+// Tokens only record where their text is in the source instead of holding a copy of it
+//  - the source buffer has to stay alive for as long as the lexer or anything holding on to token text
+//  - tokens are lexed on demand as the parser consumes them, only the lookahead window is ever held in memory
 class Lexer {
-    std::vector<std::pair<Token, std::string>> mTokens;
-    size_t mCurrTokenIndex;
+    struct TokenInfo {
+        Token mType;
+        uint32_t mOffset;
+        uint32_t mLength;
+        SourceLocation mLocation;
+    };
+    // ring buffer of tokens that have been lexed but not consumed yet, the first one is the current token
+    static constexpr size_t lookaheadSize = 4;
+
+    std::string_view mSource;
+    size_t mPosition = 0;
+    size_t mLineStart = 0;
+    uint32_t mLine = 1;
+    std::array<TokenInfo, lookaheadSize> mLookahead;
+    size_t mLookaheadStart = 0;
+    size_t mLookaheadCount = 0;
 public:
-    Lexer(std::string input);
+    Lexer(std::string_view input);
 
     Token getCurrToken() const;
-    const std::string& getCurrTokenStr() const;
+    std::string_view getCurrTokenStr() const;
+    SourceLocation getCurrTokenLocation() const;
     void consumeToken();
+    // looks at the token the given distance past the current one without consuming anything
+    //  - the distance has to be less than the lookahead size
+    Token peekToken(size_t distance);
 private:
-    void checkAndAddSingleToken(char c);
+    TokenInfo lexToken();
+    // the token covers the input from start up to the current position
+    TokenInfo makeToken(Token type, size_t start, SourceLocation location) const;
+    void fillLookahead(size_t count);
 };
\ No newline at end of file
@@ -15,10 +15,14 @@ enum class Token {
     RIGHT_SQUARE_BRACKET,
 
     FUNC_DEF,
+    EXTERN,
+    FASTMATH,
+    CONTRACT,
     FUNC_RETURN,
     VAR_DEF,
     ASSIGN,
     ARRAY_DECAY,
+    RANGE,
 
     PLUS,
     MINUS,
@@ -38,11 +42,18 @@ enum class Token {
     THEN,
     ELSE,
     LOOP,
+    FOR,
+    PARALLEL,
+    REDUCE,
+    IN,
     BREAK,
 
     TYPE_I32,
     TYPE_F32,
     TYPE_BOOL,
+    TYPE_F32X4,
+    TYPE_F32X8,
+    TYPE_I32X8,
 
     TOK_EOF
 };
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include "linker.h"
+
+#include <optional>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/VersionTuple.h"
+#include "llvm/Support/raw_ostream.h"
+
+#ifdef VELVET_HAS_LLD
+#include "lld/Common/CommonLinkerContext.h"
+#include "lld/Common/Driver.h"
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char** environ;
+#endif
+
+namespace {
+    // the support library generated code calls into (e.g. for parallel loops), the build system passes in its file name
+    constexpr const char* runtimeLibraryName = VELVET_RUNTIME_LIBRARY;
+    // where the runtime is installed to, relative to the directory the compiler is installed to
+    constexpr const char* runtimeInstallDirectory = VELVET_RUNTIME_INSTALL_DIRECTORY;
+
+#ifdef _WIN32
+    constexpr const char* defaultOutputFile = "main.exe";
+#else
+    constexpr const char* defaultOutputFile = "main";
+#endif
+
+#if defined(VELVET_HAS_LLD) && !defined(_WIN32)
+    // everything the compiler driver adds to link a dynamically linked, position independent x86-64 glibc program
+    //  - the same startup objects and libraries the cc fallback ends up with, so both link the same executable
+    //  - only the usual multiarch and lib64 layouts are looked at, anything else goes through the system linker
+    struct CRuntime {
+        std::string mDirectory;
+        // crtbeginS.o, crtendS.o and libgcc come with gcc rather than the C library
+        std::string mGCCDirectory;
+        std::string mDynamicLinker;
+    };
+
+    // the newest gcc installed for the target, the same one clang's driver picks
+    std::optional<std::string> _findGCCDirectory() {
+        constexpr const char* gccTriples[] = { "x86_64-linux-gnu", "x86_64-pc-linux-gnu", "x86_64-redhat-linux", "x86_64-suse-linux" };
+        std::optional<std::string> newestDirectory;
+        llvm::VersionTuple newestVersion;
+        for (const char* gccTriple : gccTriples) {
+            std::error_code errorCode;
+            for (llvm::sys::fs::directory_iterator entry(std::string("/usr/lib/gcc/") + gccTriple, errorCode), end; entry != end && !errorCode; entry.increment(errorCode)) {
+                // tryParse returns true if the name isn't a version
+                llvm::VersionTuple version;
+                if (version.tryParse(llvm::sys::path::filename(entry->path())) || (newestDirectory && version <= newestVersion)) {
+                    continue;
+                }
+                if (llvm::sys::fs::exists(entry->path() + "/crtbeginS.o") && llvm::sys::fs::exists(entry->path() + "/crtendS.o")) {
+                    newestDirectory = entry->path();
+                    newestVersion = version;
+                }
+            }
+        }
+        return newestDirectory;
+    }
+
+    std::optional<CRuntime> _findCRuntime() {
+        // the loader, directories and emulation are only right for x86-64 glibc, every other host links through cc
+        //  - -mcpu and -march only pick the cpu, objects are always built for the default triple
+        const llvm::Triple triple(llvm::sys::getDefaultTargetTriple());
+        if (triple.getArch() != llvm::Triple::x86_64 || !triple.isOSLinux() || triple.getEnvironment() != llvm::Triple::GNU) {
+            return std::nullopt;
+        }
+        constexpr const char* dynamicLinker = "/lib64/ld-linux-x86-64.so.2";
+        constexpr const char* directories[] = { "/usr/lib/x86_64-linux-gnu", "/usr/lib64", "/usr/lib" };
+        if (!llvm::sys::fs::exists(dynamicLinker)) {
+            return std::nullopt;
+        }
+        const std::optional<std::string> gccDirectory = _findGCCDirectory();
+        if (!gccDirectory) {
+            return std::nullopt;
+        }
+        for (const char* directory : directories) {
+            const std::string path(directory);
+            if (llvm::sys::fs::exists(path + "/Scrt1.o") && llvm::sys::fs::exists(path + "/crti.o") && llvm::sys::fs::exists(path + "/crtn.o")) {
+                return CRuntime{ path, gccDirectory.value(), dynamicLinker };
+            }
+        }
+        return std::nullopt;
+    }
+#endif
+
+    // the runtime is looked for next to the compiler, which is where it is in a build tree, and then where it's installed
+    //  - relative to the compiler and not where it was built, so builds can be moved and installed
+    std::optional<std::string> _findRuntimeLibrary(std::string& searchedDirectories) {
+        const std::string compiler = llvm::sys::fs::getMainExecutable("", reinterpret_cast<void*>(&_findRuntimeLibrary));
+        if (compiler.empty()) {
+            return std::nullopt;
+        }
+        const llvm::SmallString<256> compilerDirectory = llvm::sys::path::parent_path(compiler);
+        llvm::SmallString<256> installDirectory = compilerDirectory;
+        llvm::sys::path::append(installDirectory, runtimeInstallDirectory);
+        for (const llvm::SmallString<256>& directory : { compilerDirectory, installDirectory }) {
+            llvm::SmallString<256> path = directory;
+            llvm::sys::path::append(path, runtimeLibraryName);
+            if (llvm::sys::fs::exists(path)) {
+                return path.str().str();
+            }
+            searchedDirectories += searchedDirectories.empty() ? directory.str().str() : " or " + directory.str().str();
+        }
+        return std::nullopt;
+    }
+}
+
+ExecutableLinker::ExecutableLinker(ErrorHandler& errorHandler)
+    : mErrorHandler(errorHandler)
+{
+
+}
+
+bool ExecutableLinker::link(const std::vector<std::string>& objectFiles, const std::string& outputFile) {
+    const std::string output = getOutputFileName(outputFile);
+    std::string searchedDirectories;
+    const std::optional<std::string> runtimeLibrary = _findRuntimeLibrary(searchedDirectories);
+    if (!runtimeLibrary) {
+        mErrorHandler.logError("Could not find the velvet runtime library " + std::string(runtimeLibraryName) + (searchedDirectories.empty() ? "" : " in " + searchedDirectories) + ", it is needed to link " + output);
+        return false;
+    }
+#if defined(VELVET_HAS_LLD) && !defined(_WIN32)
+    if (std::optional<CRuntime> runtime = _findCRuntime()) {
+        return _linkWithLLD(objectFiles, output, runtimeLibrary.value(), runtime->mDirectory, runtime->mGCCDirectory, runtime->mDynamicLinker);
+    }
+#endif
+    return _runSystemLinker(objectFiles, output, runtimeLibrary.value());
+}
+
+std::string ExecutableLinker::getOutputFileName(const std::string& outputFile) {
+    return outputFile.empty() ? defaultOutputFile : outputFile;
+}
+
+#if defined(VELVET_HAS_LLD) && !defined(_WIN32)
+bool ExecutableLinker::_linkWithLLD(const std::vector<std::string>& objectFiles, const std::string& outputFile, const std::string& runtimeLibrary, const std::string& runtimeDirectory, const std::string& gccDirectory, const std::string& dynamicLinker) {
+    // mirrors the line the compiler driver hands to the linker, libgcc is there for helpers the objects may call into
+    std::vector<std::string> arguments = {
+        "ld.lld", "--build-id", "--eh-frame-hdr", "-m", "elf_x86_64", "--hash-style=gnu", "-pie", "-dynamic-linker", dynamicLinker,
+        "-o", outputFile, runtimeDirectory + "/Scrt1.o", runtimeDirectory + "/crti.o", gccDirectory + "/crtbeginS.o",
+        "-L" + gccDirectory, "-L" + runtimeDirectory
+    };
+    arguments.insert(arguments.end(), objectFiles.begin(), objectFiles.end());
+    arguments.insert(arguments.end(), {
+        runtimeLibrary, "-lm", "-lpthread",
+        "-lgcc", "--push-state", "--as-needed", "-lgcc_s", "--pop-state", "-lc", "-lgcc", "--push-state", "--as-needed", "-lgcc_s", "--pop-state",
+        gccDirectory + "/crtendS.o", runtimeDirectory + "/crtn.o"
+    });
+    std::vector<const char*> argumentPointers;
+    for (const std::string& argument : arguments) {
+        argumentPointers.push_back(argument.c_str());
+    }
+
+    // LLD reports through streams, its errors are collected so they end up in the error handler like everything else
+    std::string errors;
+    llvm::raw_string_ostream errorStream(errors);
+    const bool linked = lld::elf::link(argumentPointers, llvm::outs(), errorStream, false, false);
+    lld::CommonLinkerContext::destroy();
+    if (!linked) {
+        mErrorHandler.logError("Could not link " + outputFile + ": " + errorStream.str());
+    }
+    return linked;
+}
+#endif
+
+bool ExecutableLinker::_runSystemLinker(const std::vector<std::string>& objectFiles, const std::string& outputFile, const std::string& runtimeLibrary) {
+#ifdef _WIN32
+    // TODO: perhaps want to allow passing '-v' to clang
+    std::wstring commandLine = L"clang -o " + std::wstring(outputFile.begin(), outputFile.end());
+    for (const std::string& filename : objectFiles) {
+        commandLine += L" " + std::wstring(filename.begin(), filename.end());
+    }
+    commandLine += L" " + std::wstring(runtimeLibrary.begin(), runtimeLibrary.end());
+
+    STARTUPINFO startupInfo = { sizeof(startupInfo) };
+    PROCESS_INFORMATION processInfo;
+    if (!CreateProcess(nullptr, const_cast<LPWSTR>(commandLine.c_str()), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startupInfo, &processInfo)) {
+        mErrorHandler.logError("Failed to start clang linking process");
+        return false;
+    }
+    WaitForSingleObject(processInfo.hProcess, INFINITE);
+    DWORD exitCode = 1;
+    GetExitCodeProcess(processInfo.hProcess, &exitCode);
+    CloseHandle(processInfo.hProcess);
+    CloseHandle(processInfo.hThread);
+    if (exitCode != 0) {
+        mErrorHandler.logError("Linking " + outputFile + " failed, clang exited with " + std::to_string(exitCode));
+        return false;
+    }
+    return true;
+#else
+    // the compiler driver knows where the C runtime lives, which is everything the objects need besides each other
+    std::vector<std::string> arguments = { "cc", "-o", outputFile };
+    arguments.insert(arguments.end(), objectFiles.begin(), objectFiles.end());
+    arguments.insert(arguments.end(), { runtimeLibrary, "-lm", "-lpthread" });
+    std::vector<char*> argumentPointers;
+    for (std::string& argument : arguments) {
+        argumentPointers.push_back(argument.data());
+    }
+    argumentPointers.push_back(nullptr);
+
+    pid_t process = 0;
+    if (posix_spawnp(&process, "cc", nullptr, nullptr, argumentPointers.data(), environ) != 0) {
+        mErrorHandler.logError("Failed to start cc linking process");
+        return false;
+    }
+    int status = 0;
+    if (waitpid(process, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        mErrorHandler.logError("Linking " + outputFile + " failed, cc did not exit successfully");
+        return false;
+    }
+    return true;
+#endif
+}
\ No newline at end of file
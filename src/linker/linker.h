@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "error/errorHandler.h"
+
+// Links the object files of a build into an executable
+//  - in process through LLD when velvet is built with it, which saves starting up a whole compiler driver
+//  - otherwise, or if LLD can't find the C runtime it needs, the system's compiler driver is run to do the linking
+class ExecutableLinker {
+    ErrorHandler& mErrorHandler;
+public:
+    explicit ExecutableLinker(ErrorHandler& errorHandler);
+
+    // an empty output name links to main (main.exe on Windows)
+    bool link(const std::vector<std::string>& objectFiles, const std::string& outputFile);
+    // the name of the executable link writes for the given output name
+    static std::string getOutputFileName(const std::string& outputFile);
+private:
+#if defined(VELVET_HAS_LLD) && !defined(_WIN32)
+    bool _linkWithLLD(const std::vector<std::string>& objectFiles, const std::string& outputFile, const std::string& runtimeLibrary, const std::string& runtimeDirectory, const std::string& gccDirectory, const std::string& dynamicLinker);
+#endif
+    bool _runSystemLinker(const std::vector<std::string>& objectFiles, const std::string& outputFile, const std::string& runtimeLibrary);
+};
\ No newline at end of file
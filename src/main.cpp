@@ -1,18 +1,144 @@
+#include <charconv>
+#include <string>
+#include <vector>
+
 #include "composer/composer.h"
 #include "error/errorHandler.h"
+#include "options/options.h"
+
+namespace {
+    // only plain digits, anything that doesn't fit in an unsigned int is rejected rather than truncated
+    bool _parseCount(const std::string& count, unsigned int& result) {
+        const char* countEnd = count.data() + count.size();
+        unsigned int value = 0;
+        const std::from_chars_result parsed = std::from_chars(count.data(), countEnd, value);
+        if (parsed.ec != std::errc() || parsed.ptr != countEnd) {
+            return false;
+        }
+        result = value;
+        return true;
+    }
+
+    // returns false if the argument isn't a valid option
+    //  - options that take a separate value advance the index past it
+    bool _parseOption(int argc, char* argv[], int& index, BuildOptions& options) {
+        const std::string argument = argv[index];
+        if (argument == "-O0") {
+            options.mOptimizationLevel = OptimizationLevel::O0;
+            return true;
+        }
+        if (argument == "-O1") {
+            options.mOptimizationLevel = OptimizationLevel::O1;
+            return true;
+        }
+        if (argument == "-O2") {
+            options.mOptimizationLevel = OptimizationLevel::O2;
+            return true;
+        }
+        if (argument == "-O3") {
+            options.mOptimizationLevel = OptimizationLevel::O3;
+            return true;
+        }
+        if (argument.rfind("-mcpu=", 0) == 0 || argument.rfind("-march=", 0) == 0) {
+            // there is no separate tuning target, so -march is treated the same as -mcpu
+            options.mTargetCPU = argument.substr(argument.find('=') + 1);
+            return !options.mTargetCPU.empty();
+        }
+        if (argument.rfind("-mattr=", 0) == 0) {
+            options.mTargetFeatures = argument.substr(argument.find('=') + 1);
+            return true;
+        }
+        if (argument == "-flto") {
+            options.mLinkTimeOptimization = true;
+            return true;
+        }
+        if (argument == "-ffast-math" || argument == "-fno-fast-math") {
+            options.mFastMath = argument == "-ffast-math";
+            return true;
+        }
+        // only the two extremes, there's no fmuladd style contraction limited to single expressions
+        if (argument == "-ffp-contract=fast" || argument == "-ffp-contract=off") {
+            options.mContractFloatOps = argument == "-ffp-contract=fast";
+            return true;
+        }
+        if (argument == "--run") {
+            options.mRunJIT = true;
+            return true;
+        }
+        if (argument.rfind("--cache-dir=", 0) == 0) {
+            options.mCacheDirectory = argument.substr(argument.find('=') + 1);
+            return !options.mCacheDirectory.empty();
+        }
+        if (argument == "--no-cache") {
+            options.mCacheDirectory = "";
+            return true;
+        }
+        if (argument == "-o") {
+            if (index + 1 >= argc) {
+                return false;
+            }
+            options.mOutputFile = argv[++index];
+            return !options.mOutputFile.empty();
+        }
+        if (argument == "-j") {
+            if (index + 1 >= argc) {
+                return false;
+            }
+            return _parseCount(argv[++index], options.mJobs);
+        }
+        if (argument.rfind("-j", 0) == 0) {
+            return _parseCount(argument.substr(2), options.mJobs);
+        }
+        if (argument.rfind("--codegen-partitions=", 0) == 0) {
+            return _parseCount(argument.substr(argument.find('=') + 1), options.mCodegenPartitions) && options.mCodegenPartitions > 0;
+        }
+        if (argument.rfind("--parallel-grain=", 0) == 0) {
+            return _parseCount(argument.substr(argument.find('=') + 1), options.mParallelGrainSize);
+        }
+        if (argument == "--parallel-deterministic") {
+            options.mDeterministicParallel = true;
+            return true;
+        }
+        return false;
+    }
+}
 
 int main(int argc, char* argv[]) {
     ErrorHandler handler;
-    Composer composer(handler);
+    BuildOptions options;
+    // the command line caches by default, the library leaves it up to the embedder
+    options.mCacheDirectory = ".velvetcache";
+    std::vector<std::string> inputFiles;
     for (int index = 1; index < argc; ++index) {
-        composer.addInputFile(argv[index]);
+        const std::string argument = argv[index];
+        if (argument.size() > 1 && argument[0] == '-') {
+            if (!_parseOption(argc, argv, index, options)) {
+                handler.logError("Invalid command line option " + argument);
+            }
+        }
+        else {
+            inputFiles.emplace_back(argument);
+        }
+    }
+    if (handler.hasError()) {
+        return 1;
+    }
+
+    Composer composer(handler, options);
+    for (const std::string& inputFile : inputFiles) {
+        composer.addInputFile(inputFile);
     }
 
     composer.buildAllFiles();
     if (handler.hasError()) {
         return 1;
     }
-    composer.generateExecutable();
+    if (options.mRunJIT) {
+        return composer.runMain();
+    }
+    if (!composer.generateExecutable()) {
+        return 1;
+    }
 
     return 0;
 };
\ No newline at end of file
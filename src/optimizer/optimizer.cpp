@@ -0,0 +1,74 @@
+#include "optimizer.h"
+
+#include "llvm/Analysis/LoopAnalysisManager.h"
+#include "llvm/Analysis/CGSCCPassManager.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+
+namespace {
+    llvm::OptimizationLevel _getLLVMOptimizationLevel(OptimizationLevel level) {
+        switch (level) {
+            case OptimizationLevel::O1: return llvm::OptimizationLevel::O1;
+            case OptimizationLevel::O2: return llvm::OptimizationLevel::O2;
+            case OptimizationLevel::O3: return llvm::OptimizationLevel::O3;
+            default: return llvm::OptimizationLevel::O0;
+        }
+    }
+}
+
+Optimizer::Optimizer(OptimizationLevel level, llvm::TargetMachine* targetMachine, bool linkTimeOptimization)
+    : mLevel(level)
+    , mTargetMachine(targetMachine)
+    , mLinkTimeOptimization(linkTimeOptimization)
+{
+
+}
+
+void Optimizer::optimizeModule(llvm::Module& module) {
+    _runPipeline(module, false);
+}
+
+void Optimizer::optimizeLinkedModule(llvm::Module& module) {
+    _runPipeline(module, true);
+}
+
+void Optimizer::_runPipeline(llvm::Module& module, bool isLinkedModule) {
+    // analysis managers cache results per module, so they are created fresh for every module
+    //  - otherwise a new module allocated at the address of an old one would see stale results
+    llvm::LoopAnalysisManager loopAnalysis;
+    llvm::FunctionAnalysisManager funcAnalysis;
+    llvm::CGSCCAnalysisManager CGSCCAnalysis;
+    llvm::ModuleAnalysisManager moduleAnalysis;
+
+    // same vectorizer defaults that clang uses for each optimization level
+    llvm::PipelineTuningOptions tuningOptions;
+    tuningOptions.LoopVectorization = mLevel >= OptimizationLevel::O2;
+    tuningOptions.SLPVectorization = mLevel >= OptimizationLevel::O2;
+    tuningOptions.LoopUnrolling = mLevel >= OptimizationLevel::O1;
+
+    // passing the target machine in lets the passes use the target's cost model
+    llvm::PassBuilder passBuilder(mTargetMachine, tuningOptions);
+    passBuilder.registerLoopAnalyses(loopAnalysis);
+    passBuilder.registerFunctionAnalyses(funcAnalysis);
+    passBuilder.registerCGSCCAnalyses(CGSCCAnalysis);
+    passBuilder.registerModuleAnalyses(moduleAnalysis);
+    passBuilder.crossRegisterProxies(loopAnalysis, funcAnalysis, CGSCCAnalysis, moduleAnalysis);
+
+    // the default pipeline can't be built for O0, only the minimal semantically required passes
+    //  - with link time optimization the per module pipeline is split in two, the pre link half leaves
+    //    out what works better on the whole program (e.g. most of the inlining and the vectorizers)
+    llvm::ModulePassManager modulePassManager;
+    if (mLevel == OptimizationLevel::O0) {
+        modulePassManager = passBuilder.buildO0DefaultPipeline(llvm::OptimizationLevel::O0, mLinkTimeOptimization && !isLinkedModule);
+    }
+    else if (isLinkedModule) {
+        modulePassManager = passBuilder.buildLTODefaultPipeline(_getLLVMOptimizationLevel(mLevel), nullptr);
+    }
+    else if (mLinkTimeOptimization) {
+        modulePassManager = passBuilder.buildLTOPreLinkDefaultPipeline(_getLLVMOptimizationLevel(mLevel));
+    }
+    else {
+        modulePassManager = passBuilder.buildPerModuleDefaultPipeline(_getLLVMOptimizationLevel(mLevel));
+    }
+    modulePassManager.run(module, moduleAnalysis);
+}
\ No newline at end of file
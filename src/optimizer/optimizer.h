@@ -0,0 +1,22 @@
+#pragma once
+
+#include "options/options.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+
+class Optimizer {
+    OptimizationLevel mLevel;
+    llvm::TargetMachine* mTargetMachine;
+    // modules only get the pre link part of the pipeline, the rest runs once they are all linked together
+    bool mLinkTimeOptimization;
+public:
+    Optimizer(OptimizationLevel level, llvm::TargetMachine* targetMachine, bool linkTimeOptimization = false);
+
+    // Module needs to already have the target data layout set for target specific passes to work
+    void optimizeModule(llvm::Module& module);
+    // the link time pipeline, for the module every file's (pre link optimized) module was linked into
+    void optimizeLinkedModule(llvm::Module& module);
+private:
+    void _runPipeline(llvm::Module& module, bool isLinkedModule);
+};
\ No newline at end of file
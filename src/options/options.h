@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+
+enum class OptimizationLevel {
+    O0,
+    O1,
+    O2,
+    O3
+};
+
+// Options that are shared across the different stages of the compiler
+//  - filled in from the command line in main, then passed down by the composer
+struct BuildOptions {
+    OptimizationLevel mOptimizationLevel = OptimizationLevel::O0;
+    // number of files to compile in parallel, 0 means use every hardware thread
+    unsigned int mJobs = 1;
+    // number of modules each file's functions are split into, every one is generated, optimized and emitted on its own thread
+    //  - these threads come on top of the per file jobs, and calls between partitions can't be inlined
+    unsigned int mCodegenPartitions = 1;
+    // LLVM style cpu name and feature string (e.g. "+avx2,+fma"), "native" is resolved to the host cpu
+    std::string mTargetCPU = "generic";
+    std::string mTargetFeatures = "";
+    // files are compiled to bitcode, then linked into one module that is optimized and compiled as a whole
+    //  - lets calls be inlined across files, at the cost of a serial step at the end of the build
+    bool mLinkTimeOptimization = false;
+    // every function is built as if it was marked fastmath (or contract), see FunctionDefinitionNode
+    //  - fast math implies contraction, the backend is also allowed to fuse multiplies and adds across the whole build
+    bool mFastMath = false;
+    bool mContractFloatOps = false;
+    // fewest iterations a parallel for loop is split down to, 0 lets the runtime pick from the range and thread count
+    //  - loops that give their own grain size (e.g. parallel(64) for ...) ignore this
+    unsigned int mParallelGrainSize = 0;
+    // parallel for loops give every thread a fixed block of iterations and don't steal work, so runs are repeatable
+    bool mDeterministicParallel = false;
+    // name of the linked executable, empty means main (main.exe on Windows)
+    std::string mOutputFile = "";
+    // run main in process through the JIT instead of producing an executable
+    bool mRunJIT = false;
+    // directory compiled objects are cached in between builds, empty disables the cache
+    std::string mCacheDirectory = "";
+};
\ No newline at end of file
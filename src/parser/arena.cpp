@@ -0,0 +1,28 @@
+#include "arena.h"
+
+#include <algorithm>
+
+namespace {
+    // big enough that a typical file only needs a handful of blocks
+    constexpr size_t arenaBlockSize = 64 * 1024;
+}
+
+void* AstArena::allocate(size_t size, size_t alignment) {
+    size_t padding = (alignment - reinterpret_cast<uintptr_t>(mCurrent) % alignment) % alignment;
+    if (!mCurrent || padding + size > static_cast<size_t>(mEnd - mCurrent)) {
+        // new blocks come from new[] so they are already aligned for anything the AST holds
+        _allocateBlock(size);
+        padding = 0;
+    }
+    void* result = mCurrent + padding;
+    mCurrent += padding + size;
+    return result;
+}
+
+void AstArena::_allocateBlock(size_t minimumSize) {
+    const size_t blockSize = std::max(arenaBlockSize, minimumSize);
+    // left uninitialized, everything placed in the arena is constructed in place
+    mBlocks.emplace_back(new std::byte[blockSize]);
+    mCurrent = mBlocks.back().get();
+    mEnd = mCurrent + blockSize;
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Non-owning view of a contiguous run of elements that live in an arena
+//  - kept to a pointer and a 32 bit count since AST nodes hold a lot of these
+template<typename T>
+class ArenaArray {
+    T* mData = nullptr;
+    uint32_t mSize = 0;
+public:
+    ArenaArray() = default;
+    ArenaArray(T* data, size_t size) : mData(data), mSize(static_cast<uint32_t>(size)) {}
+
+    T* begin() const { return mData; }
+    T* end() const { return mData + mSize; }
+    size_t size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+    T& operator[](size_t index) const { return mData[index]; }
+};
+
+// Bump allocator that owns every node of a single file's AST
+//  - nothing is freed individually, all the memory goes at once when the arena is destroyed
+//  - destructors are never run, so only trivially destructible types can be allocated
+class AstArena {
+    std::vector<std::unique_ptr<std::byte[]>> mBlocks;
+    std::byte* mCurrent = nullptr;
+    std::byte* mEnd = nullptr;
+public:
+    AstArena() = default;
+    AstArena(const AstArena&) = delete;
+    AstArena& operator=(const AstArena&) = delete;
+
+    void* allocate(size_t size, size_t alignment);
+
+    template<typename T, typename... Args>
+    T* create(Args&&... args) {
+        static_assert(std::is_trivially_destructible_v<T>, "arena allocated types are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T{ std::forward<Args>(args)... };
+    }
+
+    template<typename T>
+    ArenaArray<T> copyArray(const T* data, size_t size) {
+        static_assert(std::is_trivially_destructible_v<T>, "arena allocated types are never destroyed");
+        if (size == 0) {
+            return ArenaArray<T>();
+        }
+        T* destination = static_cast<T*>(allocate(sizeof(T) * size, alignof(T)));
+        std::uninitialized_copy(data, data + size, destination);
+        return ArenaArray<T>(destination, size);
+    }
+
+    template<typename T>
+    ArenaArray<T> copyArray(const std::vector<T>& elements) {
+        return copyArray(elements.data(), elements.size());
+    }
+
+private:
+    void _allocateBlock(size_t minimumSize);
+};
\ No newline at end of file
@@ -1,48 +1,63 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
-#include <memory>
 #include <variant>
 #include <optional>
 #include <utility>
 
 #include "lexer/tokens.h"
+#include "parser/arena.h"
+#include "parser/identifierTable.h"
+
+// Expression nodes are allocated from the parser's arena and only live as long as the parser does
+//  - nodes refer to each other through plain pointers and arena arrays, nothing in the tree owns anything
 
 struct IdentifierNode {
-    std::string mIdentifier;
+    // points into the source buffer the parser was given
+    std::string_view mIdentifier;
+    // interned id from the parser's identifier table, this is what codegen resolves names by
+    SymbolId mSymbol = invalidSymbol;
 };
 
 struct VariableAccessNode;
 struct NumberNode;
 struct ScopeNode;
 struct ArrayValueNode;
+struct VectorValueNode;
 struct BinaryOperationNode;
+struct ReduceNode;
 struct ConditionalNode;
 // these are really statements implemented as expressions with NO VALUE
 struct VariableDefinitionNode;
 struct AssignmentNode;
 struct LoopNode;
+struct ForNode;
 struct BreakNode;
 
-using ExpressionNodeOwner = std::variant<
-    std::unique_ptr<VariableAccessNode>,
-    std::unique_ptr<NumberNode>,
-    std::unique_ptr<ScopeNode>,
-    std::unique_ptr<ArrayValueNode>,
-    std::unique_ptr<ConditionalNode>,
-    std::unique_ptr<BinaryOperationNode>,
+using ExpressionNodeRef = std::variant<
+    VariableAccessNode*,
+    NumberNode*,
+    ScopeNode*,
+    ArrayValueNode*,
+    VectorValueNode*,
+    ConditionalNode*,
+    BinaryOperationNode*,
+    ReduceNode*,
     // statements that are implemented as definitions with NO VALUE
-    std::unique_ptr<VariableDefinitionNode>,
-    std::unique_ptr<AssignmentNode>,
-    std::unique_ptr<LoopNode>,
-    std::unique_ptr<BreakNode>
+    VariableDefinitionNode*,
+    AssignmentNode*,
+    LoopNode*,
+    ForNode*,
+    BreakNode*
 >;
+using NodeList = ArenaArray<ExpressionNodeRef>;
 
 struct VariableAccessNode {
     IdentifierNode mName;
-    std::optional<std::vector<ExpressionNodeOwner>> mArrayIndices;
-    std::optional<std::vector<ExpressionNodeOwner>> mCallArgs;
+    std::optional<NodeList> mArrayIndices;
+    std::optional<NodeList> mCallArgs;
     bool mArrayDecay;
 };
 
@@ -51,22 +66,28 @@ struct NumberNode {
 };
 
 struct ScopeNode {
-    std::vector<ExpressionNodeOwner> mExpressionList;
+    NodeList mExpressionList;
 };
 
 struct ArrayValueNode {
-    std::vector<ExpressionNodeOwner> mExpressionList;
+    NodeList mExpressionList;
+};
+
+// builds a vector from a single scalar (splat), one scalar per lane, or the lanes starting at a decayed array element
+struct VectorValueNode {
+    Token mType;
+    NodeList mArguments;
 };
 
 struct ConditionalNode {
-    ExpressionNodeOwner mCondition;
-    ExpressionNodeOwner mThen;
-    std::optional<ExpressionNodeOwner> mElse;
+    ExpressionNodeRef mCondition;
+    ExpressionNodeRef mThen;
+    std::optional<ExpressionNodeRef> mElse;
 };
 
 struct BinaryOperationNode {
-    ExpressionNodeOwner mLeft;
-    ExpressionNodeOwner mRight;
+    ExpressionNodeRef mLeft;
+    ExpressionNodeRef mRight;
     Token mOperation;
 };
 
@@ -74,8 +95,8 @@ struct VariableDefinitionNode {
     IdentifierNode mName;
     // Should type be its own identifier?
     Token mType;
-    std::vector<size_t> mArraySizes; // let empty sizes represent not array type
-    std::optional<ExpressionNodeOwner> mInitialValue;
+    ArenaArray<size_t> mArraySizes; // let empty sizes represent not array type
+    std::optional<ExpressionNodeRef> mInitialValue;
 };
 
 struct MemoryLocationNode {
@@ -84,11 +105,42 @@ struct MemoryLocationNode {
 
 struct AssignmentNode {
     MemoryLocationNode mVariable;
-    ExpressionNodeOwner mValue;
+    ExpressionNodeRef mValue;
 };
 
 struct LoopNode {
-    std::vector<ExpressionNodeOwner> mExpressionList;
+    NodeList mExpressionList;
+};
+
+// counted loop over the half open range [mStart, mEnd), the bounds are evaluated once before the loop
+//  - the loop variable is read only, which is what lets codegen give the loop a known trip count
+//  - parallel loops run their iterations across threads, so the body can't write to variables from outside it
+struct ForNode {
+    IdentifierNode mVariable;
+    ExpressionNodeRef mStart;
+    ExpressionNodeRef mEnd;
+    NodeList mExpressionList;
+    bool mIsParallel = false;
+    // fewest iterations a thread is handed at once, 0 means use the build's default
+    size_t mGrainSize = 0;
+};
+
+// how the values of a reduce loop are combined, also used by the horizontal vector builtins
+enum class ReductionKind {
+    ADD,
+    MUL,
+    MIN,
+    MAX
+};
+
+// folds the value of the last expression in every iteration of the loop into one, an empty range gives the identity
+//  - floating point values are combined in iteration order unless reassociation is allowed, which is what lets them be
+//    split into several partial results (e.g. the lanes of a vector)
+//  - parallel reduce loops always combine per chunk partial results, see the codegen for how the chunks are picked
+struct ReduceNode {
+    ReductionKind mKind = ReductionKind::ADD;
+    bool mReassociate = false;
+    ForNode mLoop;
 };
 
 // Maybe want to do loop labels and breaking to certain labels in the future?
@@ -104,7 +156,13 @@ struct FunctionDefinitionNode {
     };
 
     IdentifierNode mName;
-    std::vector<std::pair<std::string, ArgType>> mArguments;
+    std::vector<std::pair<IdentifierNode, ArgType>> mArguments;
     Token mReturnType;
-    ExpressionNodeOwner mExpression;
+    ExpressionNodeRef mExpression;
+    // declared with 'extern', defined in some other file, so there is no expression to generate
+    bool mIsExtern = false;
+    // 'fastmath' lets float math be rewritten as if there were no NaNs, infinities or signed zeros, and in any order
+    //  - 'contract' only allows a multiply and an add to be fused into one FMA, which rounds once instead of twice
+    bool mFastMath = false;
+    bool mContract = false;
 };
\ No newline at end of file
@@ -0,0 +1,14 @@
+#include "identifierTable.h"
+
+SymbolId IdentifierTable::intern(std::string_view name) {
+    auto [it, inserted] = mIds.try_emplace(name, static_cast<SymbolId>(mNames.size()));
+    if (inserted) {
+        mNames.push_back(name);
+    }
+    return it->second;
+}
+
+SymbolId IdentifierTable::find(std::string_view name) const {
+    auto it = mIds.find(name);
+    return it != mIds.end() ? it->second : invalidSymbol;
+}
\ No newline at end of file
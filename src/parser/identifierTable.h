@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// dense id for an interned identifier, ids start at 0 and count up in the order names are first seen
+using SymbolId = uint32_t;
+constexpr SymbolId invalidSymbol = std::numeric_limits<SymbolId>::max();
+
+// Interns every identifier of a file so later stages can compare and index names by id instead of hashing strings
+//  - filled in by the parser, then handed to codegen which sizes its lookup tables from it
+//  - names are views, they have to outlive the table (the source buffer, or string literals for builtins)
+class IdentifierTable {
+    std::unordered_map<std::string_view, SymbolId> mIds;
+    std::vector<std::string_view> mNames;
+public:
+    SymbolId intern(std::string_view name);
+    // invalidSymbol if the name never came up, doesn't modify the table so it's safe to call from several threads
+    SymbolId find(std::string_view name) const;
+
+    std::string_view getName(SymbolId symbol) const { return mNames[symbol]; }
+    size_t size() const { return mNames.size(); }
+};
\ No newline at end of file
@@ -1,8 +1,38 @@
 #include "parser.h"
 
+#include <charconv>
+#include <string>
 #include <unordered_map>
 
 namespace {
+    // collects the children of a list node and copies them into the arena in one go once the list is done
+    //  - nested lists push on top of the same pending stack and pop back off before the outer list continues,
+    //    so a single buffer serves every level without any per-list allocation
+    //  - whatever is left over on an early error return is popped when the builder goes out of scope
+    class NodeListBuilder {
+        std::vector<ExpressionNodeRef>& mPendingNodes;
+        const size_t mStart;
+    public:
+        explicit NodeListBuilder(std::vector<ExpressionNodeRef>& pendingNodes)
+            : mPendingNodes(pendingNodes)
+            , mStart(pendingNodes.size()) {}
+        ~NodeListBuilder() {
+            mPendingNodes.resize(mStart);
+        }
+
+        void add(ExpressionNodeRef node) {
+            mPendingNodes.push_back(node);
+        }
+        bool empty() const {
+            return mPendingNodes.size() == mStart;
+        }
+        NodeList finish(AstArena& arena) {
+            NodeList list = arena.copyArray(mPendingNodes.data() + mStart, mPendingNodes.size() - mStart);
+            mPendingNodes.resize(mStart);
+            return list;
+        }
+    };
+
     const std::unordered_map<Token, int> binaryOperators = {
         { Token::EQUALS, 0 },
         { Token::NOT_EQUALS, 0 },
@@ -19,25 +49,30 @@ namespace {
     };
 }
 
-Parser::Parser(std::string input, ErrorHandler& handler) : mLexer(input), mErrorHandler(handler) {}
+Parser::Parser(std::string_view input, ErrorHandler& handler) : mLexer(input), mErrorHandler(handler) {}
 
 std::vector<FunctionDefinitionNode>& Parser::parseAll() {
-    while(mLexer.getCurrToken() == Token::FUNC_DEF) {
+    while(mLexer.getCurrToken() == Token::FUNC_DEF || mLexer.getCurrToken() == Token::EXTERN
+        || mLexer.getCurrToken() == Token::FASTMATH || mLexer.getCurrToken() == Token::CONTRACT) {
         mTopLevelFunctions.emplace_back(std::move(parseFunctionDefinition()));
     }
     return mTopLevelFunctions;
 }
 
+IdentifierTable& Parser::getIdentifiers() {
+    return mIdentifiers;
+}
+
 /// ExpressionNode
 ///     ::= Primary
 ///     ::= BinaryOperation
-ExpressionNodeOwner Parser::parseExpression() {
-    ExpressionNodeOwner primary = parsePrimary();
+ExpressionNodeRef Parser::parseExpression() {
+    ExpressionNodeRef primary = parsePrimary();
     
     // check if primary should be used for binary operation
     Token currToken = mLexer.getCurrToken();
     if (binaryOperators.find(currToken) != binaryOperators.end()) {
-        return std::make_unique<BinaryOperationNode>(parseBinaryOperation(std::move(primary)));
+        return parseBinaryOperation(primary);
     }
     return primary;
 }
@@ -46,7 +81,8 @@ ExpressionNodeOwner Parser::parseExpression() {
 ///   ::= identifier
 IdentifierNode Parser::parseIdentifier() {
     if (mLexer.getCurrToken() == Token::ID) {
-        IdentifierNode identifier = IdentifierNode{ mLexer.getCurrTokenStr() };
+        const std::string_view name = mLexer.getCurrTokenStr();
+        IdentifierNode identifier = IdentifierNode{ name, mIdentifiers.intern(name) };
         mLexer.consumeToken();
         return identifier;
     }
@@ -60,49 +96,67 @@ IdentifierNode Parser::parseIdentifier() {
 ///   ::= VariableAccessNode
 ///   ::= NumberNode
 ///   ::= ScopeNode
+///   ::= VectorValueNode
 ///   ::= ConditionalNode
 ///   ::= VariableDefinitionNode
 ///   ::= LoopNode
+///   ::= ForNode
+///   ::= 'parallel' ForNode
+///   ::= ReduceNode
 ///   ::= BreakNode
-ExpressionNodeOwner Parser::parsePrimary() {
+ExpressionNodeRef Parser::parsePrimary() {
     switch(mLexer.getCurrToken()) {
         case Token::ID: {
             VariableAccessNode variable = parseVariableAccess(false);
             if (mLexer.getCurrToken() == Token::ASSIGN) {
-                return std::make_unique<AssignmentNode>(parseAssignment(std::move(variable)));
+                return mArena.create<AssignmentNode>(parseAssignment(std::move(variable)));
             }
             else {
-                return std::make_unique<VariableAccessNode>(std::move(variable));
+                return mArena.create<VariableAccessNode>(variable);
             }
         } break;
         case Token::ARRAY_DECAY: {
             mLexer.consumeToken();
-            return std::make_unique<VariableAccessNode>(parseVariableAccess(true));
+            return mArena.create<VariableAccessNode>(parseVariableAccess(true));
         } break;
         case Token::NUM: {
-            return std::make_unique<NumberNode>(parseNumber());
+            return mArena.create<NumberNode>(parseNumber());
         } break;
         case Token::LEFT_BRACKET: {
-            return std::make_unique<ScopeNode>(parseScope());
+            return mArena.create<ScopeNode>(parseScope());
         } break;
         case Token::LEFT_SQUARE_BRACKET: {
-            return std::make_unique<ArrayValueNode>(parseArrayValue());
+            return mArena.create<ArrayValueNode>(parseArrayValue());
+        } break;
+        case Token::TYPE_F32X4:
+        case Token::TYPE_F32X8:
+        case Token::TYPE_I32X8: {
+            return mArena.create<VectorValueNode>(parseVectorValue());
         } break;
         case Token::IF: {
-            return std::make_unique<ConditionalNode>(parseConditional());
+            return mArena.create<ConditionalNode>(parseConditional());
         } break;
         case Token::VAR_DEF: {
-            return std::make_unique<VariableDefinitionNode>(parseVariableDefinition());
+            return mArena.create<VariableDefinitionNode>(parseVariableDefinition());
         } break;
         case Token::LOOP: {
-            return std::make_unique<LoopNode>(parseLoop());
+            return mArena.create<LoopNode>(parseLoop());
+        } break;
+        case Token::FOR: {
+            return mArena.create<ForNode>(parseFor());
+        } break;
+        case Token::PARALLEL: {
+            return mArena.create<ForNode>(parseParallelFor());
+        } break;
+        case Token::REDUCE: {
+            return mArena.create<ReduceNode>(parseReduce());
         } break;
         case Token::BREAK: {
-            return std::make_unique<BreakNode>(parseBreak());
+            return mArena.create<BreakNode>(parseBreak());
         } break;
         default: {
             mErrorHandler.logError("Unexpected token when parsing primary.");
-            return std::unique_ptr<VariableAccessNode>();
+            return static_cast<VariableAccessNode*>(nullptr);
         } break;
     }
 }
@@ -111,27 +165,27 @@ ExpressionNodeOwner Parser::parsePrimary() {
 VariableAccessNode Parser::parseVariableAccess(bool arrDecay) {
     IdentifierNode identifier = parseIdentifier();
     // TODO: Need to figure out how to handle chained brackets (e.g. arrayVar[2][3][4])
-    std::vector<ExpressionNodeOwner> arrayExpressions;
+    NodeListBuilder arrayExpressions(mPendingNodes);
     while (_checkAndConsumeToken(Token::LEFT_SQUARE_BRACKET)) {
-        arrayExpressions.emplace_back(parseExpression());
+        arrayExpressions.add(parseExpression());
         if (!_checkAndConsumeToken(Token::RIGHT_SQUARE_BRACKET)) {
             mErrorHandler.logError("Expected ']' at the end of array access");
-            return VariableAccessNode{ identifier, std::move(arrayExpressions), std::nullopt };
+            return VariableAccessNode{ identifier, arrayExpressions.finish(mArena), std::nullopt, arrDecay };
         }
     }
     if (!arrayExpressions.empty()) {
-        return VariableAccessNode{ identifier, std::move(arrayExpressions), std::nullopt };
+        return VariableAccessNode{ identifier, arrayExpressions.finish(mArena), std::nullopt, arrDecay };
     }
     if (_checkAndConsumeToken(Token::LEFT_PARENTHESIS)) {
-        std::vector<ExpressionNodeOwner> argExpressions;
+        NodeListBuilder argExpressions(mPendingNodes);
         while(!_checkAndConsumeToken(Token::RIGHT_PARENTHESIS)) {
-            argExpressions.emplace_back(parseExpression());
+            argExpressions.add(parseExpression());
             if (!_checkAndConsumeToken(Token::COMMA) && mLexer.getCurrToken() != Token::RIGHT_PARENTHESIS) {
                 mErrorHandler.logError("Expected ',' between argument expressions for function call parameter");
                 return VariableAccessNode{ identifier, std::nullopt, std::nullopt };
             }
         }
-        return VariableAccessNode{ identifier, std::nullopt, std::move(argExpressions), arrDecay };
+        return VariableAccessNode{ identifier, std::nullopt, argExpressions.finish(mArena), arrDecay };
     }
     return VariableAccessNode{ identifier, std::nullopt, std::nullopt, arrDecay };
 }
@@ -143,8 +197,8 @@ AssignmentNode Parser::parseAssignment(VariableAccessNode&& variable) {
         mErrorHandler.logError("Expected assignment token '='");
         return AssignmentNode{ std::move(memoryLocation) };
     }
-    ExpressionNodeOwner expression = parseExpression();
-    return AssignmentNode{ std::move(memoryLocation), std::move(expression) };
+    ExpressionNodeRef expression = parseExpression();
+    return AssignmentNode{ std::move(memoryLocation), expression };
 }
 
 /// LoopNode ::= 'loop' ScopeNode
@@ -161,9 +215,9 @@ LoopNode Parser::parseLoop() {
         mErrorHandler.logError("Empty loop is not valid code");
         return LoopNode{};
     }
-    std::vector<ExpressionNodeOwner> expressions;
+    NodeListBuilder expressions(mPendingNodes);
     while(mLexer.getCurrToken() != Token::RIGHT_BRACKET) {
-        expressions.emplace_back(parseExpression());
+        expressions.add(parseExpression());
         if (!_checkAndConsumeToken(Token::SEMICOLON)) {
             mErrorHandler.logError("Expressions in loop must end with a semicolon");
             return LoopNode{};
@@ -172,7 +226,117 @@ LoopNode Parser::parseLoop() {
     if (!_checkAndConsumeToken(Token::RIGHT_BRACKET)) {
         mErrorHandler.logError("Expected right bracket at the end of loop expression");
     }
-    return LoopNode { std::move(expressions) };
+    return LoopNode { expressions.finish(mArena) };
+}
+
+/// ForNode ::= 'for' IdentifierNode 'in' ExpressionNode '..' ExpressionNode ScopeNode
+ForNode Parser::parseFor() {
+    if (!_checkAndConsumeToken(Token::FOR)) {
+        mErrorHandler.logError("Expected 'for' token at start of for loop");
+        return ForNode{};
+    }
+    IdentifierNode variable = parseIdentifier();
+    if (!_checkAndConsumeToken(Token::IN)) {
+        mErrorHandler.logError("Expected 'in' after the for loop variable");
+        return ForNode{};
+    }
+    ExpressionNodeRef start = parseExpression();
+    if (!_checkAndConsumeToken(Token::RANGE)) {
+        mErrorHandler.logError("Expected '..' between the bounds of the for loop range");
+        return ForNode{};
+    }
+    ExpressionNodeRef end = parseExpression();
+    if (!_checkAndConsumeToken(Token::LEFT_BRACKET)) {
+        mErrorHandler.logError("Expected left bracket at the start of for loop expression");
+        return ForNode{};
+    }
+    NodeListBuilder expressions(mPendingNodes);
+    while (mLexer.getCurrToken() != Token::RIGHT_BRACKET) {
+        expressions.add(parseExpression());
+        if (!_checkAndConsumeToken(Token::SEMICOLON)) {
+            mErrorHandler.logError("Expressions in for loop must end with a semicolon");
+            return ForNode{};
+        }
+    }
+    if (!_checkAndConsumeToken(Token::RIGHT_BRACKET)) {
+        mErrorHandler.logError("Expected right bracket at the end of for loop expression");
+    }
+    return ForNode{ variable, start, end, expressions.finish(mArena) };
+}
+
+/// ForNode ::= 'parallel' ('(' NumberNode ')')? ForNode
+ForNode Parser::parseParallelFor() {
+    if (!_checkAndConsumeToken(Token::PARALLEL)) {
+        mErrorHandler.logError("Expected 'parallel' token at start of parallel for loop");
+        return ForNode{};
+    }
+    size_t grainSize = 0;
+    if (_checkAndConsumeToken(Token::LEFT_PARENTHESIS)) {
+        NumberNode number = parseNumber();
+        int* grain = std::get_if<int>(&number.mNumber);
+        if (!grain || *grain <= 0) {
+            mErrorHandler.logError("Expected positive integer value for parallel grain size");
+        }
+        else {
+            grainSize = *grain;
+        }
+        if (!_checkAndConsumeToken(Token::RIGHT_PARENTHESIS)) {
+            mErrorHandler.logError("Expected ')' after parallel grain size");
+            return ForNode{};
+        }
+    }
+    ForNode forLoop = parseFor();
+    forLoop.mIsParallel = true;
+    forLoop.mGrainSize = grainSize;
+    return forLoop;
+}
+
+/// ReduceNode ::= 'reduce' '(' ('+' | '*' | 'min' | 'max') (',' 'reassoc')? ')' ForNode
+///   ::= 'reduce' '(' ('+' | '*' | 'min' | 'max') (',' 'reassoc')? ')' 'parallel' ('(' NumberNode ')')? ForNode
+ReduceNode Parser::parseReduce() {
+    if (!_checkAndConsumeToken(Token::REDUCE)) {
+        mErrorHandler.logError("Expected 'reduce' token at start of reduce loop");
+        return ReduceNode{};
+    }
+    if (!_checkAndConsumeToken(Token::LEFT_PARENTHESIS)) {
+        mErrorHandler.logError("Expected '(' before the reduce operation");
+        return ReduceNode{};
+    }
+    // min and max aren't keywords, they're only special here so they can still be used as names everywhere else
+    ReduceNode reduce;
+    const Token operation = mLexer.getCurrToken();
+    const std::string_view operationName = mLexer.getCurrTokenStr();
+    if (operation == Token::PLUS) {
+        reduce.mKind = ReductionKind::ADD;
+    }
+    else if (operation == Token::MULTIPLY) {
+        reduce.mKind = ReductionKind::MUL;
+    }
+    else if (operation == Token::ID && operationName == "min") {
+        reduce.mKind = ReductionKind::MIN;
+    }
+    else if (operation == Token::ID && operationName == "max") {
+        reduce.mKind = ReductionKind::MAX;
+    }
+    else {
+        mErrorHandler.logError("Expected one of +, *, min or max as the reduce operation");
+        return ReduceNode{};
+    }
+    mLexer.consumeToken();
+    if (_checkAndConsumeToken(Token::COMMA)) {
+        if (mLexer.getCurrToken() != Token::ID || mLexer.getCurrTokenStr() != "reassoc") {
+            mErrorHandler.logError("Expected reassoc after ',' in the reduce operation");
+            return ReduceNode{};
+        }
+        mLexer.consumeToken();
+        reduce.mReassociate = true;
+    }
+    if (!_checkAndConsumeToken(Token::RIGHT_PARENTHESIS)) {
+        mErrorHandler.logError("Expected ')' after the reduce operation");
+        return ReduceNode{};
+    }
+    reduce.mLoop = mLexer.getCurrToken() == Token::PARALLEL ? parseParallelFor() : parseFor();
+    return reduce;
 }
 
 /// BreakNode ::= 'break'
@@ -187,19 +351,26 @@ BreakNode Parser::parseBreak() {
 /// NumberNode ::= number
 NumberNode Parser::parseNumber() {
     if (mLexer.getCurrToken() == Token::NUM) {
-        const std::string& numString = mLexer.getCurrTokenStr();
-        if (numString.find('.') == std::string::npos) {
-            const int numVal = std::stoi(mLexer.getCurrTokenStr());
-            NumberNode number = NumberNode{ numVal };
-            mLexer.consumeToken();
-            return number;
+        // parsed straight from the source text, std::stoi/stof would need a string copy of every number
+        const std::string_view numString = mLexer.getCurrTokenStr();
+        const char* numEnd = numString.data() + numString.size();
+        NumberNode number = NumberNode{ 0 };
+        std::from_chars_result result;
+        if (numString.find('.') == std::string_view::npos) {
+            int numVal = 0;
+            result = std::from_chars(numString.data(), numEnd, numVal);
+            number = NumberNode{ numVal };
         }
         else {
-            const float numVal = std::stof(mLexer.getCurrTokenStr());
-            NumberNode number = NumberNode{ numVal };
-            mLexer.consumeToken();
-            return number;
+            float numVal = 0.f;
+            result = std::from_chars(numString.data(), numEnd, numVal);
+            number = NumberNode{ numVal };
+        }
+        if (result.ec != std::errc()) {
+            mErrorHandler.logError("Invalid number literal " + std::string(numString));
         }
+        mLexer.consumeToken();
+        return number;
     }
     else {
         mErrorHandler.logError("Expected numerical token when parsing number");
@@ -217,16 +388,16 @@ ScopeNode Parser::parseScope() {
         // empty scope
         return ScopeNode{};
     }
-    std::vector<ExpressionNodeOwner> expressions;
-    expressions.emplace_back(parseExpression());
+    NodeListBuilder expressions(mPendingNodes);
+    expressions.add(parseExpression());
     while(_checkAndConsumeToken(Token::SEMICOLON)) {
-        expressions.emplace_back(parseExpression());
+        expressions.add(parseExpression());
     }
     if(!_checkAndConsumeToken(Token::RIGHT_BRACKET)) {
         mErrorHandler.logError("Expected right bracket at the end of scope expression");
         return ScopeNode{};
     }
-    return ScopeNode { std::move(expressions) };
+    return ScopeNode { expressions.finish(mArena) };
 }
 
 /// ArrayValueNode ::= '[' (ExpressionNode, ',')* ']'
@@ -235,20 +406,40 @@ ArrayValueNode Parser::parseArrayValue() {
         mErrorHandler.logError("Expected left square bracket at start of array value expression");
         return ArrayValueNode{};
     }
-    std::vector<ExpressionNodeOwner> expressions;
+    NodeListBuilder expressions(mPendingNodes);
     if (_checkAndConsumeToken(Token::RIGHT_SQUARE_BRACKET)) {
         // Handle empty array value
         return ArrayValueNode{};
     }
-    expressions.emplace_back(parseExpression());
+    expressions.add(parseExpression());
     while(_checkAndConsumeToken(Token::COMMA)) {
-        expressions.emplace_back(std::move(parseExpression()));
+        expressions.add(parseExpression());
     }
     if (!_checkAndConsumeToken(Token::RIGHT_SQUARE_BRACKET)) {
         mErrorHandler.logError("Expected right square bracket at end of array value expression");
         return ArrayValueNode{};
     }
-    return ArrayValueNode{ std::move(expressions) };
+    return ArrayValueNode{ expressions.finish(mArena) };
+}
+
+/// VectorValueNode ::= VectorType '(' ExpressionNode (',' ExpressionNode)* ')'
+VectorValueNode Parser::parseVectorValue() {
+    const Token type = mLexer.getCurrToken();
+    mLexer.consumeToken();
+    if (!_checkAndConsumeToken(Token::LEFT_PARENTHESIS)) {
+        mErrorHandler.logError("Expected left parenthesis after vector type");
+        return VectorValueNode{ type };
+    }
+    NodeListBuilder expressions(mPendingNodes);
+    expressions.add(parseExpression());
+    while (_checkAndConsumeToken(Token::COMMA)) {
+        expressions.add(parseExpression());
+    }
+    if (!_checkAndConsumeToken(Token::RIGHT_PARENTHESIS)) {
+        mErrorHandler.logError("Expected right parenthesis at end of vector value expression");
+        return VectorValueNode{ type };
+    }
+    return VectorValueNode{ type, expressions.finish(mArena) };
 }
 
 /// ConditionalNode ::= 'if' ExpressionNode 'then' ExpressionNode ('else' ExpressionNode)?
@@ -257,39 +448,38 @@ ConditionalNode Parser::parseConditional() {
         mErrorHandler.logError("Expected 'if' at the start of if expression");
         return ConditionalNode{};
     }
-    ExpressionNodeOwner conditionExpression = parseExpression();
+    ExpressionNodeRef conditionExpression = parseExpression();
     if (!_checkAndConsumeToken(Token::THEN)) {
         mErrorHandler.logError("Expected 'then' after if condition");
         return ConditionalNode{};
     }
-    ExpressionNodeOwner thenExpression = parseExpression();
+    ExpressionNodeRef thenExpression = parseExpression();
     if (!_checkAndConsumeToken(Token::ELSE)) {
-        return ConditionalNode{ std::move(conditionExpression), std::move(thenExpression), std::nullopt };
+        return ConditionalNode{ conditionExpression, thenExpression, std::nullopt };
     }
-    ExpressionNodeOwner elseExpression = parseExpression();
-    return ConditionalNode{ std::move(conditionExpression), std::move(thenExpression), std::move(elseExpression) };
+    ExpressionNodeRef elseExpression = parseExpression();
+    return ConditionalNode{ conditionExpression, thenExpression, elseExpression };
 }
 
 /// BinaryOperationNode ::= ExpressionNode op ExpressionNode
-BinaryOperationNode Parser::parseBinaryOperation(ExpressionNodeOwner left) {
+BinaryOperationNode* Parser::parseBinaryOperation(ExpressionNodeRef left) {
     // if we are in this function, assume that the curr token IS a binary operation
     Token binaryOperator = mLexer.getCurrToken();
     const int currPrecedence = binaryOperators.at(binaryOperator);
     mLexer.consumeToken();
 
-    ExpressionNodeOwner right = parseExpression();
+    ExpressionNodeRef right = parseExpression();
     // handling operator precedence if rhs is binary node as well
-    if (auto binop = std::get_if<std::unique_ptr<BinaryOperationNode>>(&right)) {
-        std::unique_ptr<BinaryOperationNode>& binaryOperation = *binop;
+    if (auto binop = std::get_if<BinaryOperationNode*>(&right)) {
+        BinaryOperationNode* binaryOperation = *binop;
         const int nextPrecedence = binaryOperators.at(binaryOperation->mOperation);
         if (currPrecedence > nextPrecedence) {
-            BinaryOperationNode newLHS{ std::move(left), std::move(binaryOperation->mLeft), binaryOperator };
-            binaryOperation->mLeft = std::make_unique<BinaryOperationNode>(std::move(newLHS));
-            // feels mega unsafe... maybe improve this somehow
-            return std::move(*binaryOperation.release());
+            // rotate so this operation binds tighter, the rhs node becomes the root
+            binaryOperation->mLeft = mArena.create<BinaryOperationNode>(left, binaryOperation->mLeft, binaryOperator);
+            return binaryOperation;
         }
     }
-    return BinaryOperationNode{ std::move(left), std::move(right), binaryOperator };
+    return mArena.create<BinaryOperationNode>(left, right, binaryOperator);
 }
 
 /// VariableDefinitionNode ::= 'var' IdentifierNode (':=' ExpressionNode)?
@@ -324,14 +514,14 @@ VariableDefinitionNode Parser::parseVariableDefinition() {
         }
         if (!_checkAndConsumeToken(Token::RIGHT_SQUARE_BRACKET)) {
             mErrorHandler.logError("Expected ']' to end array type definition");
-            return VariableDefinitionNode{ identifier, typeInfo, arraySizes, std::nullopt };
+            return VariableDefinitionNode{ identifier, typeInfo, mArena.copyArray(arraySizes), std::nullopt };
         }
         if (!_checkAndConsumeToken(Token::ASSIGN)) {
-            return VariableDefinitionNode{ identifier, typeInfo, arraySizes, std::nullopt };
+            return VariableDefinitionNode{ identifier, typeInfo, mArena.copyArray(arraySizes), std::nullopt };
         }
         // TODO: Maybe check that this is an arrayValue node, or even parse it directly?
-        ExpressionNodeOwner initialArrayValue = parseExpression();
-        return VariableDefinitionNode{ identifier, typeInfo, arraySizes, std::move(initialArrayValue) };
+        ExpressionNodeRef initialArrayValue = parseExpression();
+        return VariableDefinitionNode{ identifier, typeInfo, mArena.copyArray(arraySizes), initialArrayValue };
     }
     else {
         Token typeInfo = mLexer.getCurrToken();
@@ -339,13 +529,26 @@ VariableDefinitionNode Parser::parseVariableDefinition() {
         if (!_checkAndConsumeToken(Token::ASSIGN)) {
             return VariableDefinitionNode{ identifier, typeInfo, {}, std::nullopt };
         }
-        ExpressionNodeOwner initialValue = parseExpression();
-        return VariableDefinitionNode{ identifier, typeInfo, {}, std::move(initialValue) };
+        ExpressionNodeRef initialValue = parseExpression();
+        return VariableDefinitionNode{ identifier, typeInfo, {}, initialValue };
     }
 }
 
-/// FunctionDefinitionNode ::= 'def' IdentifierNode '(' (IdentifierNode ',')* IdentifierNode? ')' expressionNode
+/// FunctionDefinitionNode
+///     ::= 'def' IdentifierNode '(' (IdentifierNode ',')* IdentifierNode? ')' expressionNode
+///     ::= 'extern' 'def' IdentifierNode '(' (IdentifierNode ',')* IdentifierNode? ')' ';'
+///     ::= ('fastmath' | 'contract')+ 'def' IdentifierNode '(' (IdentifierNode ',')* IdentifierNode? ')' expressionNode
 FunctionDefinitionNode Parser::parseFunctionDefinition() {
+    const bool isExtern = _checkAndConsumeToken(Token::EXTERN);
+    bool isFastMath = false;
+    bool isContract = false;
+    while (mLexer.getCurrToken() == Token::FASTMATH || mLexer.getCurrToken() == Token::CONTRACT) {
+        (mLexer.getCurrToken() == Token::FASTMATH ? isFastMath : isContract) = true;
+        mLexer.consumeToken();
+    }
+    if (isExtern && (isFastMath || isContract)) {
+        mErrorHandler.logError("fastmath and contract only apply to functions with a body, not extern declarations");
+    }
     if (!_checkAndConsumeToken(Token::FUNC_DEF)) {
         mErrorHandler.logError("Expected 'def' at the start of function definition");
         return FunctionDefinitionNode{};
@@ -355,10 +558,9 @@ FunctionDefinitionNode Parser::parseFunctionDefinition() {
         mErrorHandler.logError("Expected left parenthesis in function definition");
         return FunctionDefinitionNode { identifier };
     }
-    std::vector<std::pair<std::string, FunctionDefinitionNode::ArgType>> arguments;
+    std::vector<std::pair<IdentifierNode, FunctionDefinitionNode::ArgType>> arguments;
     while (mLexer.getCurrToken() == Token::ID) {
-        std::string name = mLexer.getCurrTokenStr();
-        mLexer.consumeToken();
+        IdentifierNode name = parseIdentifier();
         if (!_checkAndConsumeToken(Token::COLON)) {
             mErrorHandler.logError("Expected ':' after argument name");
             return FunctionDefinitionNode{ identifier };
@@ -412,8 +614,15 @@ FunctionDefinitionNode Parser::parseFunctionDefinition() {
     }
     Token returnType = mLexer.getCurrToken();
     mLexer.consumeToken();
-    ExpressionNodeOwner expression = parseExpression();
-    return FunctionDefinitionNode{ identifier, arguments, returnType, std::move(expression) };
+    // the body of an extern function is in another file, only the signature is needed to call it
+    if (isExtern) {
+        if (!_checkAndConsumeToken(Token::SEMICOLON)) {
+            mErrorHandler.logError("Expected ';' after extern function declaration");
+        }
+        return FunctionDefinitionNode{ identifier, arguments, returnType, {}, true };
+    }
+    ExpressionNodeRef expression = parseExpression();
+    return FunctionDefinitionNode{ identifier, arguments, returnType, expression, false, isFastMath, isContract };
 }
 
 bool Parser::_checkAndConsumeToken(Token target) {
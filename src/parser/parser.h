@@ -1,37 +1,53 @@
 #pragma once
 
+#include <string_view>
 #include <vector>
 
 #include "error/errorHandler.h"
 
 #include "lexer/lexer.h"
+#include "parser/arena.h"
+#include "parser/identifierTable.h"
 #include "parser/ast.h"
 
+// Builds the AST for a single file
+//  - every expression node lives in the parser's arena, so the AST can't outlive the parser
 class Parser {
+    AstArena mArena;
+    // children of lists that are still being parsed, see NodeListBuilder in parser.cpp
+    std::vector<ExpressionNodeRef> mPendingNodes;
     Lexer mLexer;
+    IdentifierTable mIdentifiers;
     // TODO: This should probably contain more than just function definitions
     std::vector<FunctionDefinitionNode> mTopLevelFunctions;
 
     ErrorHandler& mErrorHandler;
 public:
-    Parser(std::string input, ErrorHandler& handler);
+    // the input has to outlive the parser and its AST, identifiers point straight into it
+    Parser(std::string_view input, ErrorHandler& handler);
 
     std::vector<FunctionDefinitionNode>& parseAll();
+    // every identifier seen so far, codegen for this parser's AST has to use the same table
+    IdentifierTable& getIdentifiers();
 
-    ExpressionNodeOwner parseExpression();
+    ExpressionNodeRef parseExpression();
     IdentifierNode parseIdentifier();
 
-    ExpressionNodeOwner parsePrimary();
+    ExpressionNodeRef parsePrimary();
     VariableAccessNode parseVariableAccess(bool arrDecay);
     NumberNode parseNumber();
     ScopeNode parseScope();
     ArrayValueNode parseArrayValue();
+    VectorValueNode parseVectorValue();
     ConditionalNode parseConditional();
 
-    BinaryOperationNode parseBinaryOperation(ExpressionNodeOwner left);
+    BinaryOperationNode* parseBinaryOperation(ExpressionNodeRef left);
     VariableDefinitionNode parseVariableDefinition();
     AssignmentNode parseAssignment(VariableAccessNode&& variable);
     LoopNode parseLoop();
+    ForNode parseFor();
+    ForNode parseParallelFor();
+    ReduceNode parseReduce();
     BreakNode parseBreak();
 
     FunctionDefinitionNode parseFunctionDefinition();
@@ -0,0 +1,363 @@
+#include "parallel.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+// thin layer over the platform's threads, only what the pool below needs
+#ifdef _WIN32
+typedef SRWLOCK Mutex;
+typedef CONDITION_VARIABLE Condition;
+#define THREAD_LOCAL __declspec(thread)
+
+static void _initMutex(Mutex* mutex) { InitializeSRWLock(mutex); }
+static void _initCondition(Condition* condition) { InitializeConditionVariable(condition); }
+static void _lock(Mutex* mutex) { AcquireSRWLockExclusive(mutex); }
+static void _unlock(Mutex* mutex) { ReleaseSRWLockExclusive(mutex); }
+static void _wait(Condition* condition, Mutex* mutex) { SleepConditionVariableSRW(condition, mutex, INFINITE, 0); }
+static void _broadcast(Condition* condition) { WakeAllConditionVariable(condition); }
+static void _yield(void) { SwitchToThread(); }
+
+static int _getHardwareThreads(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+#else
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Condition;
+#define THREAD_LOCAL _Thread_local
+
+static void _initMutex(Mutex* mutex) { pthread_mutex_init(mutex, NULL); }
+static void _initCondition(Condition* condition) { pthread_cond_init(condition, NULL); }
+static void _lock(Mutex* mutex) { pthread_mutex_lock(mutex); }
+static void _unlock(Mutex* mutex) { pthread_mutex_unlock(mutex); }
+static void _wait(Condition* condition, Mutex* mutex) { pthread_cond_wait(condition, mutex); }
+static void _broadcast(Condition* condition) { pthread_cond_broadcast(condition); }
+static void _yield(void) { sched_yield(); }
+
+static int _getHardwareThreads(void) {
+    return (int)sysconf(_SC_NPROCESSORS_ONLN);
+}
+#endif
+
+typedef struct {
+    int64_t mBegin;
+    int64_t mEnd;
+} Range;
+
+// ranges are split in half until they reach the grain size, so this covers any 64 bit range
+#define DEQUE_CAPACITY 64
+
+// the ranges one worker still has to run, the owner works from the bottom and thieves take from the top
+//  - the bottom has the smallest, most recently split ranges, so the owner stays close to what it just ran
+//    while a thief walks away with the biggest piece of work there is
+//  - a plain lock per deque is enough, every range holds at least a grain of iterations
+typedef struct {
+    Mutex mLock;
+    Range mRanges[DEQUE_CAPACITY];
+    int mTop;
+    int mBottom;
+} WorkDeque;
+
+typedef struct {
+    VelvetLoopBody mBody;
+    void* mContext;
+    int64_t mGrainSize;
+    bool mDeterministic;
+} Job;
+
+typedef struct {
+    // held for a whole loop, the pool only runs one loop at a time
+    Mutex mCallLock;
+    Mutex mLock;
+    Condition mWorkAvailable;
+    Condition mWorkDone;
+    // index 0 belongs to whichever thread called into the runtime, the rest to the pool's own threads
+    WorkDeque* mDeques;
+    int mWorkerCount;
+    // bumped for every job so sleeping workers can tell a new job from a spurious wake up
+    uint64_t mGeneration;
+    // lives on the calling thread's stack, so the call can't return while a worker is still looking at it
+    Job* mJob;
+    int64_t mRemaining;
+    int mActiveWorkers;
+} ThreadPool;
+
+static ThreadPool pool;
+// set on every thread that is running loop iterations, a nested parallel loop just runs serially
+static THREAD_LOCAL bool inParallelLoop = false;
+
+static void _initDeque(WorkDeque* deque) {
+    _initMutex(&deque->mLock);
+    deque->mTop = 0;
+    deque->mBottom = 0;
+}
+
+static bool _pushRange(WorkDeque* deque, Range range) {
+    _lock(&deque->mLock);
+    const bool pushed = deque->mBottom < DEQUE_CAPACITY;
+    if (pushed) {
+        deque->mRanges[deque->mBottom++] = range;
+    }
+    _unlock(&deque->mLock);
+    return pushed;
+}
+
+static bool _popRange(WorkDeque* deque, Range* range) {
+    _lock(&deque->mLock);
+    const bool popped = deque->mBottom > deque->mTop;
+    if (popped) {
+        *range = deque->mRanges[--deque->mBottom];
+    }
+    if (deque->mBottom == deque->mTop) {
+        deque->mTop = 0;
+        deque->mBottom = 0;
+    }
+    _unlock(&deque->mLock);
+    return popped;
+}
+
+static bool _stealRange(WorkDeque* deque, Range* range) {
+    _lock(&deque->mLock);
+    const bool stolen = deque->mBottom > deque->mTop;
+    if (stolen) {
+        *range = deque->mRanges[deque->mTop++];
+    }
+    if (deque->mBottom == deque->mTop) {
+        deque->mTop = 0;
+        deque->mBottom = 0;
+    }
+    _unlock(&deque->mLock);
+    return stolen;
+}
+
+static void _finishIterations(int64_t count) {
+    _lock(&pool.mLock);
+    pool.mRemaining -= count;
+    if (pool.mRemaining == 0) {
+        _broadcast(&pool.mWorkDone);
+    }
+    _unlock(&pool.mLock);
+}
+
+static bool _takeRange(const Job* job, int worker, Range* range) {
+    for (;;) {
+        if (_popRange(&pool.mDeques[worker], range)) {
+            return true;
+        }
+        // without stealing a worker is done once its own block is
+        if (job->mDeterministic) {
+            return false;
+        }
+        for (int offset = 1; offset < pool.mWorkerCount; offset++) {
+            if (_stealRange(&pool.mDeques[(worker + offset) % pool.mWorkerCount], range)) {
+                return true;
+            }
+        }
+        // the ranges that are still running can be split further, so only give up once every iteration is done
+        _lock(&pool.mLock);
+        const bool done = pool.mRemaining == 0;
+        _unlock(&pool.mLock);
+        if (done) {
+            return false;
+        }
+        _yield();
+    }
+}
+
+static void _runRange(const Job* job, int worker, Range range) {
+    const int64_t count = range.mEnd - range.mBegin;
+    if (job->mDeterministic) {
+        for (int64_t begin = range.mBegin; begin < range.mEnd; begin += job->mGrainSize) {
+            const int64_t end = range.mEnd - begin > job->mGrainSize ? begin + job->mGrainSize : range.mEnd;
+            job->mBody(job->mContext, begin, end);
+        }
+        _finishIterations(count);
+        return;
+    }
+    // split lazily, the upper halves are left where idle workers can steal them
+    while (range.mEnd - range.mBegin > job->mGrainSize) {
+        const int64_t middle = range.mBegin + (range.mEnd - range.mBegin) / 2;
+        const Range upper = { middle, range.mEnd };
+        if (!_pushRange(&pool.mDeques[worker], upper)) {
+            break;
+        }
+        range.mEnd = middle;
+    }
+    job->mBody(job->mContext, range.mBegin, range.mEnd);
+    _finishIterations(range.mEnd - range.mBegin);
+}
+
+static void _runWorker(const Job* job, int worker) {
+    Range range;
+    while (_takeRange(job, worker, &range)) {
+        _runRange(job, worker, range);
+    }
+}
+
+static void _workerMain(int worker) {
+    inParallelLoop = true;
+    uint64_t seenGeneration = 0;
+    _lock(&pool.mLock);
+    for (;;) {
+        while (pool.mGeneration == seenGeneration) {
+            _wait(&pool.mWorkAvailable, &pool.mLock);
+        }
+        seenGeneration = pool.mGeneration;
+        // woke up too late, the job already finished without this worker
+        if (!pool.mJob) {
+            continue;
+        }
+        Job* job = pool.mJob;
+        pool.mActiveWorkers++;
+        _unlock(&pool.mLock);
+        _runWorker(job, worker);
+        _lock(&pool.mLock);
+        if (--pool.mActiveWorkers == 0) {
+            _broadcast(&pool.mWorkDone);
+        }
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI _workerEntry(LPVOID worker) {
+    _workerMain((int)(intptr_t)worker);
+    return 0;
+}
+
+static bool _startWorker(int worker) {
+    HANDLE thread = CreateThread(NULL, 0, _workerEntry, (LPVOID)(intptr_t)worker, 0, NULL);
+    if (!thread) {
+        return false;
+    }
+    CloseHandle(thread);
+    return true;
+}
+#else
+static void* _workerEntry(void* worker) {
+    _workerMain((int)(intptr_t)worker);
+    return NULL;
+}
+
+static bool _startWorker(int worker) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, _workerEntry, (void*)(intptr_t)worker) != 0) {
+        return false;
+    }
+    pthread_detach(thread);
+    return true;
+}
+#endif
+
+// the worker threads live until the process exits, they sleep while no loop is running
+static void _initializePool(void) {
+    int workerCount = 0;
+    const char* threadCount = getenv("VELVET_NUM_THREADS");
+    if (threadCount) {
+        workerCount = atoi(threadCount);
+    }
+    if (workerCount <= 0) {
+        workerCount = _getHardwareThreads();
+    }
+    if (workerCount <= 0) {
+        workerCount = 1;
+    }
+    _initMutex(&pool.mCallLock);
+    _initMutex(&pool.mLock);
+    _initCondition(&pool.mWorkAvailable);
+    _initCondition(&pool.mWorkDone);
+    pool.mDeques = (WorkDeque*)malloc(sizeof(WorkDeque) * (size_t)workerCount);
+    if (!pool.mDeques) {
+        pool.mWorkerCount = 1;
+        return;
+    }
+    for (int worker = 0; worker < workerCount; worker++) {
+        _initDeque(&pool.mDeques[worker]);
+    }
+    // if a thread can't be started the pool just makes do with the ones that could
+    pool.mWorkerCount = 1;
+    while (pool.mWorkerCount < workerCount && _startWorker(pool.mWorkerCount)) {
+        pool.mWorkerCount++;
+    }
+}
+
+#ifdef _WIN32
+static INIT_ONCE poolInitialized = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK _initializePoolOnce(PINIT_ONCE initOnce, PVOID parameter, PVOID* context) {
+    _initializePool();
+    return TRUE;
+}
+
+static void _ensurePool(void) {
+    InitOnceExecuteOnce(&poolInitialized, _initializePoolOnce, NULL, NULL);
+}
+#else
+static pthread_once_t poolInitialized = PTHREAD_ONCE_INIT;
+
+static void _ensurePool(void) {
+    pthread_once(&poolInitialized, _initializePool);
+}
+#endif
+
+void velvet_parallel_for(VelvetLoopBody body, void* context, int64_t begin, int64_t end, int64_t grainSize, int32_t deterministic) {
+    if (end <= begin) {
+        return;
+    }
+    _ensurePool();
+    const int64_t count = end - begin;
+    if (grainSize <= 0) {
+        // a few tasks per worker leaves room to even out iterations that take different amounts of time
+        grainSize = count / ((int64_t)pool.mWorkerCount * 8);
+        if (grainSize < 1) {
+            grainSize = 1;
+        }
+    }
+    if (inParallelLoop || pool.mWorkerCount == 1 || count <= grainSize) {
+        body(context, begin, end);
+        return;
+    }
+
+    _lock(&pool.mCallLock);
+    Job job = { body, context, grainSize, deterministic != 0 };
+    // every worker starts out with an even, contiguous block of the range
+    const int64_t blockSize = count / pool.mWorkerCount;
+    const int64_t leftover = count % pool.mWorkerCount;
+    int64_t blockBegin = begin;
+    for (int worker = 0; worker < pool.mWorkerCount; worker++) {
+        const int64_t blockEnd = blockBegin + blockSize + (worker < leftover ? 1 : 0);
+        if (blockEnd > blockBegin) {
+            const Range block = { blockBegin, blockEnd };
+            _pushRange(&pool.mDeques[worker], block);
+        }
+        blockBegin = blockEnd;
+    }
+
+    _lock(&pool.mLock);
+    pool.mJob = &job;
+    pool.mRemaining = count;
+    pool.mGeneration++;
+    _broadcast(&pool.mWorkAvailable);
+    _unlock(&pool.mLock);
+
+    // the calling thread works on the loop too instead of just waiting for it
+    inParallelLoop = true;
+    _runWorker(&job, 0);
+    inParallelLoop = false;
+
+    _lock(&pool.mLock);
+    while (pool.mRemaining > 0 || pool.mActiveWorkers > 0) {
+        _wait(&pool.mWorkDone, &pool.mLock);
+    }
+    pool.mJob = NULL;
+    _unlock(&pool.mLock);
+    _unlock(&pool.mCallLock);
+}
\ No newline at end of file
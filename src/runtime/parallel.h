@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+// Support code for 'parallel for' loops, linked into every executable and into the JIT
+//  - written in C so executables don't pick up a dependency on a C++ standard library
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// what codegen outlines a parallel loop's body into, runs the iterations in [begin, end)
+typedef void (*VelvetLoopBody)(void* context, int64_t begin, int64_t end);
+
+// runs body over [begin, end) split across a pool of worker threads, returns once every iteration is done
+//  - grainSize is the fewest iterations a task gets split down to, 0 picks one from the range and thread count
+//  - deterministic gives every worker a fixed block of the range and turns off stealing,
+//    so the same iterations always run together on the same thread
+//  - the thread count comes from VELVET_NUM_THREADS, or the number of hardware threads if that isn't set
+//  - calls from inside a parallel loop body run serially on the calling thread
+void velvet_parallel_for(VelvetLoopBody body, void* context, int64_t begin, int64_t end, int64_t grainSize, int32_t deterministic);
+
+#ifdef __cplusplus
+}
+#endif
\ No newline at end of file